@@ -0,0 +1,270 @@
+/***************************************************************
+                          assetcache.c
+                               
+Lazily loads sprites, models, and fonts through handles, and
+frees the least recently used ones when over a memory budget.
+***************************************************************/
+
+#include <libdragon.h>
+#include <string.h>
+#include "assetcache.h"
+
+
+/*********************************
+             Globals
+*********************************/
+
+// Loaded handles, from most to least recently used
+static AssetHandle* global_assetcache_head = NULL;
+static AssetHandle* global_assetcache_tail = NULL;
+
+// Memory accounting
+static size_t global_assetcache_usage = 0;
+static size_t global_assetcache_budget = 0;
+
+
+/*==============================
+    assetcache_unlink
+    Removes a handle from the list of loaded handles
+    @param  The handle to remove
+==============================*/
+
+static void assetcache_unlink(AssetHandle* handle)
+{
+    if (handle->prev != NULL)
+        handle->prev->next = handle->next;
+    else
+        global_assetcache_head = handle->next;
+    if (handle->next != NULL)
+        handle->next->prev = handle->prev;
+    else
+        global_assetcache_tail = handle->prev;
+    handle->prev = NULL;
+    handle->next = NULL;
+}
+
+
+/*==============================
+    assetcache_push
+    Adds a handle to the front of the list of loaded handles
+    @param  The handle to add
+==============================*/
+
+static void assetcache_push(AssetHandle* handle)
+{
+    handle->prev = NULL;
+    handle->next = global_assetcache_head;
+    if (global_assetcache_head != NULL)
+        global_assetcache_head->prev = handle;
+    else
+        global_assetcache_tail = handle;
+    global_assetcache_head = handle;
+}
+
+
+/*==============================
+    assetcache_unload
+    Frees the data of a loaded handle
+    @param  The handle to unload
+==============================*/
+
+static void assetcache_unload(AssetHandle* handle)
+{
+    switch (handle->type)
+    {
+        case ASSETTYPE_SPRITE: sprite_free((sprite_t*)handle->data); break;
+        case ASSETTYPE_MODEL:  t3d_model_free((T3DModel*)handle->data); break;
+        case ASSETTYPE_FONT:   rdpq_font_free((rdpq_font_t*)handle->data); break;
+    }
+    assetcache_unlink(handle);
+    global_assetcache_usage -= handle->size;
+    handle->data = NULL;
+    handle->size = 0;
+}
+
+
+/*==============================
+    assetcache_evict
+    Frees least recently used assets until the cache fits
+    in the budget again
+    @param  The handle that must stay loaded
+==============================*/
+
+static void assetcache_evict(AssetHandle* keep)
+{
+    bool waited = false;
+    if (global_assetcache_budget == 0)
+        return;
+    while (global_assetcache_usage > global_assetcache_budget && global_assetcache_tail != keep)
+    {
+        // The RSP and RDP might still be reading from the asset
+        if (!waited)
+        {
+            rspq_wait();
+            waited = true;
+        }
+        assetcache_unload(global_assetcache_tail);
+    }
+}
+
+
+/*==============================
+    assethandle_resolve
+    Makes sure a handle is loaded and marks it as
+    the most recently used one
+    @param  The handle to resolve
+    @param  The type the caller expects
+    @return The loaded data
+==============================*/
+
+static void* assethandle_resolve(AssetHandle* handle, AssetType type)
+{
+    assertf(handle->type == type, "Asset '%s' is of type %d, not %d", handle->path, handle->type, type);
+
+    // Already loaded, just bump it to the front
+    if (handle->data != NULL)
+    {
+        if (handle != global_assetcache_head)
+        {
+            assetcache_unlink(handle);
+            assetcache_push(handle);
+        }
+        return handle->data;
+    }
+
+    // Load it, measuring how much heap it took
+    heap_stats_t before, after;
+    sys_get_heap_stats(&before);
+    switch (type)
+    {
+        case ASSETTYPE_SPRITE: handle->data = sprite_load(handle->path); break;
+        case ASSETTYPE_MODEL:  handle->data = t3d_model_load(handle->path); break;
+        case ASSETTYPE_FONT:   handle->data = rdpq_font_load(handle->path); break;
+    }
+    sys_get_heap_stats(&after);
+    handle->size = (after.used > before.used) ? (after.used - before.used) : 0;
+    global_assetcache_usage += handle->size;
+    assetcache_push(handle);
+
+    assetcache_evict(handle);
+    return handle->data;
+}
+
+
+/*==============================
+    assethandle_init
+    Sets up a handle without loading anything
+    @param  The handle to initialize
+    @param  The type of asset
+    @param  The path of the asset in the filesystem
+==============================*/
+
+void assethandle_init(AssetHandle* handle, AssetType type, const char* path)
+{
+    assertf(strlen(path) < ASSET_PATH_MAX, "Asset path '%s' is too long", path);
+    strcpy(handle->path, path);
+    handle->type = type;
+    handle->data = NULL;
+    handle->size = 0;
+    handle->prev = NULL;
+    handle->next = NULL;
+}
+
+
+/*==============================
+    assethandle_get_sprite
+    Gets the sprite of a handle, loading it if needed.
+    This marks the asset as the most recently used one.
+    @param  The handle of the sprite
+    @return The loaded sprite
+==============================*/
+
+sprite_t* assethandle_get_sprite(AssetHandle* handle)
+{
+    return (sprite_t*)assethandle_resolve(handle, ASSETTYPE_SPRITE);
+}
+
+
+/*==============================
+    assethandle_get_model
+    Gets the model of a handle, loading it if needed.
+    This marks the asset as the most recently used one.
+    @param  The handle of the model
+    @return The loaded model
+==============================*/
+
+T3DModel* assethandle_get_model(AssetHandle* handle)
+{
+    return (T3DModel*)assethandle_resolve(handle, ASSETTYPE_MODEL);
+}
+
+
+/*==============================
+    assethandle_get_font
+    Gets the font of a handle, loading it if needed.
+    This marks the asset as the most recently used one.
+    Fonts registered with rdpq_text_register_font
+    must not be evicted, so keep them within budget.
+    @param  The handle of the font
+    @return The loaded font
+==============================*/
+
+rdpq_font_t* assethandle_get_font(AssetHandle* handle)
+{
+    return (rdpq_font_t*)assethandle_resolve(handle, ASSETTYPE_FONT);
+}
+
+
+/*==============================
+    assethandle_release
+    Frees the asset of a handle if it is loaded.
+    The handle can still be used afterwards.
+    @param  The handle to release
+==============================*/
+
+void assethandle_release(AssetHandle* handle)
+{
+    if (handle->data != NULL)
+        assetcache_unload(handle);
+}
+
+
+/*==============================
+    assetcache_set_budget
+    Sets how much memory loaded assets can use before the
+    least recently used ones are freed. Evicting waits for
+    the RSP and RDP to be done with the asset.
+    @param  The budget in bytes, or 0 for no limit
+==============================*/
+
+void assetcache_set_budget(size_t bytes)
+{
+    global_assetcache_budget = bytes;
+    assetcache_evict(global_assetcache_head);
+}
+
+
+/*==============================
+    assetcache_get_usage
+    Gets how much memory loaded assets are using
+    @return The memory used, in bytes
+==============================*/
+
+size_t assetcache_get_usage()
+{
+    return global_assetcache_usage;
+}
+
+
+/*==============================
+    assetcache_flush
+    Frees every loaded asset and resets the budget.
+    Called by the core after a minigame is cleaned up.
+==============================*/
+
+void assetcache_flush()
+{
+    while (global_assetcache_head != NULL)
+        assetcache_unload(global_assetcache_head);
+    global_assetcache_budget = 0;
+}
@@ -0,0 +1,114 @@
+#ifndef GAMEJAM2024_ASSETCACHE_H
+#define GAMEJAM2024_ASSETCACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    #include <t3d/t3d.h>
+    #include <t3d/t3dmodel.h>
+
+
+    /***************************************************************
+                      Public Asset Cache Constants
+    ***************************************************************/
+
+    #define ASSET_PATH_MAX  64
+
+    // The kind of asset a handle resolves to
+    typedef enum {
+        ASSETTYPE_SPRITE,
+        ASSETTYPE_MODEL,
+        ASSETTYPE_FONT,
+    } AssetType;
+
+    // A lazily loaded asset. Only the path is kept until the asset is first used
+    typedef struct AssetHandle {
+        AssetType type;
+        char path[ASSET_PATH_MAX];
+        void* data;
+        size_t size;
+        struct AssetHandle* prev;
+        struct AssetHandle* next;
+    } AssetHandle;
+
+
+    /***************************************************************
+                      Public Asset Cache Functions
+    ***************************************************************/
+
+    /*==============================
+        assethandle_init
+        Sets up a handle without loading anything
+        @param  The handle to initialize
+        @param  The type of asset
+        @param  The path of the asset in the filesystem
+    ==============================*/
+    void assethandle_init(AssetHandle* handle, AssetType type, const char* path);
+
+    /*==============================
+        assethandle_get_sprite
+        Gets the sprite of a handle, loading it if needed.
+        This marks the asset as the most recently used one.
+        @param  The handle of the sprite
+        @return The loaded sprite
+    ==============================*/
+    sprite_t* assethandle_get_sprite(AssetHandle* handle);
+
+    /*==============================
+        assethandle_get_model
+        Gets the model of a handle, loading it if needed.
+        This marks the asset as the most recently used one.
+        @param  The handle of the model
+        @return The loaded model
+    ==============================*/
+    T3DModel* assethandle_get_model(AssetHandle* handle);
+
+    /*==============================
+        assethandle_get_font
+        Gets the font of a handle, loading it if needed.
+        This marks the asset as the most recently used one.
+        Fonts registered with rdpq_text_register_font
+        must not be evicted, so keep them within budget.
+        @param  The handle of the font
+        @return The loaded font
+    ==============================*/
+    rdpq_font_t* assethandle_get_font(AssetHandle* handle);
+
+    /*==============================
+        assethandle_release
+        Frees the asset of a handle if it is loaded.
+        The handle can still be used afterwards.
+        @param  The handle to release
+    ==============================*/
+    void assethandle_release(AssetHandle* handle);
+
+    /*==============================
+        assetcache_set_budget
+        Sets how much memory loaded assets can use before the
+        least recently used ones are freed. Evicting waits for
+        the RSP and RDP to be done with the asset.
+        @param  The budget in bytes, or 0 for no limit
+    ==============================*/
+    void assetcache_set_budget(size_t bytes);
+
+    /*==============================
+        assetcache_get_usage
+        Gets how much memory loaded assets are using
+        @return The memory used, in bytes
+    ==============================*/
+    size_t assetcache_get_usage();
+
+
+    /***************************************************************
+                     Internal Asset Cache Functions
+                  Do not use anything below this line
+    ***************************************************************/
+
+    void assetcache_flush();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
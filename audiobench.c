@@ -0,0 +1,155 @@
+/***************************************************************
+                          audiobench.c
+
+Measures what each audio file in the ROM costs to decode and mix,
+so the codec of every asset can be picked knowing the tradeoff.
+***************************************************************/
+
+#include <libdragon.h>
+#include <string.h>
+#include "core.h"
+#include "audiobench.h"
+
+
+/*********************************
+             Globals
+*********************************/
+
+static int16_t* global_audiobench_buffer;
+static uint32_t global_audiobench_baseline;
+
+
+/*==============================
+    audiobench_mix
+    Mixes whatever is playing on the mixer, up to the given
+    amount of samples
+    @param  The most samples to mix
+    @param  Whether to stop once channel 0 goes quiet
+    @param  Where to store the number of samples mixed
+    @return The ticks spent in the mixer
+==============================*/
+
+static uint32_t audiobench_mix(int maxsamples, bool untilquiet, int* mixed)
+{
+    uint32_t ticks = 0;
+    *mixed = 0;
+    while (*mixed < maxsamples)
+    {
+        uint32_t start = get_ticks();
+        mixer_poll(global_audiobench_buffer, AUDIOBENCH_BUFFERLEN);
+        ticks += TICKS_DISTANCE(start, get_ticks());
+        *mixed += AUDIOBENCH_BUFFERLEN;
+        if (untilquiet && !mixer_ch_playing(0))
+            break;
+    }
+    return ticks;
+}
+
+
+/*==============================
+    audiobench_measure
+    Plays a single file and logs its cost
+    @param  The path of the wav64 or xm64 file
+==============================*/
+
+static void audiobench_measure(const char* path)
+{
+    wav64_t wav;
+    xm64player_t xm;
+    bool isxm = strstr(path, ".xm64") != NULL;
+    int frequency = audio_get_frequency();
+    int mixed;
+    uint32_t ticks;
+    uint32_t baseline;
+    uint32_t costus;
+    long size;
+
+    // Get the size on the ROM
+    FILE* file = fopen(path, "rb");
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fclose(file);
+
+    if (isxm)
+    {
+        xm64player_open(&xm, path);
+        xm64player_set_loop(&xm, false);
+        xm64player_play(&xm, 0);
+    }
+    else
+    {
+        wav64_open(&wav, path);
+        wav64_play(&wav, 0);
+    }
+
+    // Take away what the mixer costs with nothing playing, so only the file itself is left
+    ticks = audiobench_mix(AUDIOBENCH_SECONDS*frequency, !isxm, &mixed);
+    baseline = ((uint64_t)global_audiobench_baseline*mixed)/AUDIOBENCH_BUFFERLEN;
+    ticks = ticks > baseline ? ticks - baseline : 0;
+    costus = TICKS_TO_US((uint64_t)ticks*frequency/mixed);
+    debugf("  %-32s %8ld bytes %8lu us/s (%lu.%lu%% CPU)\n", path, size, costus, costus/10000, (costus/1000)%10);
+
+    if (isxm)
+    {
+        xm64player_stop(&xm);
+        xm64player_close(&xm);
+    }
+    else
+    {
+        mixer_ch_stop(0);
+        wav64_close(&wav);
+    }
+}
+
+
+/*==============================
+    audiobench_scan
+    Measures every audio file in a folder and the folders
+    inside it
+    @param  The folder to go through, ending in a slash
+==============================*/
+
+static void audiobench_scan(const char* folder)
+{
+    dir_t dir;
+    if (dir_findfirst(folder, &dir) < 0)
+        return;
+    do
+    {
+        char path[strlen(folder) + strlen(dir.d_name) + 2];
+        if (dir.d_type == DT_DIR)
+        {
+            sprintf(path, "%s%s/", folder, dir.d_name);
+            audiobench_scan(path);
+        }
+        else if (strstr(dir.d_name, ".wav64") || strstr(dir.d_name, ".xm64"))
+        {
+            sprintf(path, "%s%s", folder, dir.d_name);
+            audiobench_measure(path);
+        }
+    }
+    while (dir_findnext(folder, &dir) == 0);
+}
+
+
+/*==============================
+    audiobench_run
+    Plays every wav64 and xm64 file in the ROM on its own,
+    as fast as the mixer allows, and logs how big each one
+    is and how long decoding and mixing it takes per second
+    of audio. Run by the core before the menu when
+    AUDIO_BENCHMARK is enabled in config.h.
+==============================*/
+
+void audiobench_run()
+{
+    int mixed;
+    global_audiobench_buffer = malloc_uncached(AUDIOBENCH_BUFFERLEN*2*sizeof(int16_t));
+
+    // The cost of mixing a buffer of silence
+    global_audiobench_baseline = audiobench_mix(16*AUDIOBENCH_BUFFERLEN, false, &mixed)/16;
+
+    debugf("Audio benchmark at %d Hz, decode and mix time per second of audio:\n", audio_get_frequency());
+    audiobench_scan("rom:/");
+    free_uncached(global_audiobench_buffer);
+}
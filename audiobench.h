@@ -0,0 +1,38 @@
+#ifndef GAMEJAM2024_AUDIOBENCH_H
+#define GAMEJAM2024_AUDIOBENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+    /***************************************************************
+                    Public Audio Benchmark Constants
+    ***************************************************************/
+
+    // How much of each file is played, at most
+    #define AUDIOBENCH_SECONDS    4
+
+    // How many samples are mixed at once, like a single audio buffer
+    #define AUDIOBENCH_BUFFERLEN  512
+
+
+    /***************************************************************
+                    Public Audio Benchmark Functions
+    ***************************************************************/
+
+    /*==============================
+        audiobench_run
+        Plays every wav64 and xm64 file in the ROM on its own,
+        as fast as the mixer allows, and logs how big each one
+        is and how long decoding and mixing it takes per second
+        of audio. Run by the core before the menu when
+        AUDIO_BENCHMARK is enabled in config.h.
+    ==============================*/
+    void audiobench_run();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,6 +1,9 @@
 #include <libdragon.h>
 #include "../../minigame.h"
 #include "../../core.h"
+#include "../../textcache.h"
+#include "../../sfxbank.h"
+#include "../../renderstats.h"
 #include <t3d/t3d.h>
 #include <t3d/t3dmodel.h>
 #include <t3d/t3dskeleton.h>
@@ -19,10 +22,18 @@ const MinigameDef minigame_def = {
     "Outside: Press the buttons indicated on the screen",
 };
 
+// The SFX bank and the core jingles are all at 22050 Hz. The music player
+// sets the limits of its own channels
+const MinigameAudio minigame_audio = {
+  .channels = NUM_AUDIO_CHANNELS,
+  .maxfrequency = 22050,
+};
+
 surface_t *z_buffer;
 T3DViewport viewport;
 struct camera cam;
 T3DModel *player_model;
+static struct uniform_block player_block;
 struct character players[4];
 struct scene *current_scene;
 rdpq_font_t *normal_font;
@@ -64,7 +75,6 @@ const color_t skin_tones[] = {
   (color_t) {0x41, 0x27, 0x1c, 0xff},
 };
 struct rdpq_textparms_s banner_params;
-struct rdpq_textparms_s timer_params;
 rspq_block_t *empty_hud_block;
 bool paused;
 struct subgame subgames[] = {
@@ -72,7 +82,7 @@ struct subgame subgames[] = {
     .fixed_loop = sauna_fixed_loop,
     .dynamic_loop_pre = sauna_dynamic_loop_pre,
     .dynamic_loop_render = sauna_dynamic_loop_render,
-    .dynamic_loop_post = sauna_dynamic_loop_post,
+    .dynamic_loop_post = NULL,
     .cleanup = sauna_cleanup,
     .init = sauna_init,
   },
@@ -101,15 +111,6 @@ wav64_t sfx_countdown;
 wav64_t sfx_stop;
 wav64_t sfx_winner;
 
-static bool filter_player_hair_color(void *user_data, const T3DObject *obj) {
-  color_t *color = (color_t *) user_data;
-  if (!strcmp(obj->name, "hair")) {
-    rdpq_set_prim_color(*color);
-  }
-
-  return true;
-}
-
 void minigame_init() {
   player_colors[0] = PLAYERCOLOR_1;
   player_colors[1] = PLAYERCOLOR_2;
@@ -118,7 +119,7 @@ void minigame_init() {
 
   display_init(RESOLUTION_320x240,
       DEPTH_16_BPP,
-      3,
+      NUM_FRAMEBUFFERS,
       GAMMA_NONE,
       FILTERS_RESAMPLE);
   z_buffer = display_get_zbuf();
@@ -126,23 +127,18 @@ void minigame_init() {
   t3d_init((T3DInitParams){});
   tpx_init((TPXInitParams){});
   viewport = t3d_viewport_create();
+  transforms_init();
 
   player_model = t3d_model_load("rom:/avanto/guy.t3dm");
-  T3DModelDrawConf player_draw_conf = {
-    .userData = NULL,
-    .tileCb = NULL,
-    .filterCb = filter_player_hair_color,
-    .dynTextureCb = NULL,
-    .matrices = NULL,
+  static const struct block_uniform player_uniforms[NUM_PLAYER_UNIFORMS] = {
+    [PLAYER_UNIFORM_SKIN] = {"body", UNIFORM_PRIM_COLOR},
+    [PLAYER_UNIFORM_HAIR] = {"hair", UNIFORM_PRIM_COLOR},
   };
-  static T3DObject *body_object = NULL;
-  T3DModelIter it = t3d_model_iter_create(player_model, T3D_CHUNK_TYPE_OBJECT);
-  while (t3d_model_iter_next(&it)) {
-    if (!strcmp("body", it.object->name)) {
-      body_object = it.object;
-      break;
-    }
-  }
+  instanced_block_init(&player_block,
+      player_model,
+      true,
+      player_uniforms,
+      NUM_PLAYER_UNIFORMS);
   for (size_t i = 0; i < 4; i++) {
     players[i].rotation = 0;
     skeleton_init(&players[i].s, player_model, NUM_PLAYER_ANIMS);
@@ -173,16 +169,13 @@ void minigame_init() {
     players[i].visible = false;
     players[i].temperature = 0.f;
     players[i].out = false;
-    player_draw_conf.userData = &player_colors[i];
     int skin_color_index = rand() % (sizeof(skin_tones)/sizeof(color_t));
-    body_object->material->primColor = skin_tones[skin_color_index];
-    entity_init(&players[i].e,
-        player_model,
-        &(T3DVec3) {{players[i].scale, players[i].scale, players[i].scale}},
-        &(T3DVec3) {{0, players[i].rotation, 0}},
-        &players[i].pos,
-        &players[i].s.skeleton,
-        &player_draw_conf);
+    players[i].uniforms[PLAYER_UNIFORM_SKIN].color =
+      skin_tones[skin_color_index];
+    players[i].uniforms[PLAYER_UNIFORM_HAIR].color = player_colors[i];
+    entity_init_moving(&players[i].e,
+        &player_block,
+        &players[i].s.skeleton);
   }
 
   const color_t BLACK = RGBA32(0x00, 0x00, 0x00, 0xff);
@@ -233,11 +226,6 @@ void minigame_init() {
   banner_params.valign = 1;
   banner_params.width = 320;
 
-  memset(&timer_params, 0, sizeof(timer_params));
-  timer_params.style_id = SW_TIMER;
-  timer_params.align = 1;
-  timer_params.width = 320;
-
   xm64player_open(&music, "rom:/avanto/sj-polkka.xm64");
 
   wav64_open(&sfx_start, "rom:/core/Start.wav64");
@@ -246,14 +234,17 @@ void minigame_init() {
   wav64_open(&sfx_winner, "rom:/core/Winner.wav64");
 
   mixer_set_vol(1.f);
-  for (int i = xm64player_num_channels(&music); i < 32; i++) {
+  assertf(xm64player_num_channels(&music) <= NUM_MUSIC_CHANNELS,
+      "Music has too many channels");
+  for (int i = NUM_MUSIC_CHANNELS; i < NUM_AUDIO_CHANNELS; i++) {
     mixer_ch_set_vol(i, 0.5f, 0.5f);
-    mixer_ch_set_limits(i, 0, 48000, 0);
   }
 
   empty_hud_block = build_empty_hud_block();
+  hud_init();
 
   paused = false;
+  input_clear();
 
   current_subgame = &subgames[0];
   current_subgame->init();
@@ -278,83 +269,96 @@ void minigame_loop(float delta_time) {
   static int paused_controller = 0;
   static int paused_selection = 0;
   static surface_t *first_paused = NULL;
+  static bool pause_dirty = false;
+
+  if (!paused) {
+    input_end_frame();
+  }
 
   if (current_subgame->dynamic_loop_pre && !paused) {
     current_subgame->dynamic_loop_pre(delta_time);
   }
 
-  surface_t *display_surface;
-  display_surface = display_get();
-  rdpq_attach(display_surface, z_buffer);
-  t3d_frame_start();
-  t3d_viewport_attach(&viewport);
+  // While paused, the screen only changes with the selection, so it is left
+  // on display and the core is told not to expect new frames
+  if (!paused || pause_dirty) {
+    surface_t *display_surface;
+    display_surface = display_get();
+    rdpq_attach(display_surface, z_buffer);
+
+    if (!paused) {
+      t3d_frame_start();
+      t3d_viewport_attach(&viewport);
+      if (current_subgame->dynamic_loop_render) {
+        current_subgame->dynamic_loop_render(delta_time);
+      }
+    }
 
-  if (current_subgame->dynamic_loop_render && !paused) {
-    current_subgame->dynamic_loop_render(delta_time);
-  }
+    rstat_sync_pipe("avanto 2d");
+    rstat_mode_push("avanto 2d");
+    rdpq_mode_zbuf(false, false);
+
+    if (paused) {
+      if (!first_paused) {
+        rstat_mode_push("avanto pause");
+        rdpq_set_fog_color(RGBA32(0xff, 0xff, 0xff, 0xc0));
+        rdpq_set_prim_color(RGBA32(0x00, 0x00, 0x00, 0xff));
+        rdpq_mode_combiner(RDPQ_COMBINER_FLAT);
+        rdpq_mode_blender(RDPQ_BLENDER_MULTIPLY_CONST);
+        rdpq_fill_rectangle(0, 0, 320, 240);
+        rdpq_mode_pop();
+
+        first_paused = display_surface;
+      }
+      else if (first_paused != display_surface) {
+        rstat_mode_push("avanto pause");
+        rstat_set_mode_copy("avanto pause", false);
+        rstat_tex_blit("avanto pause", first_paused, 0, 0, NULL);
+        rdpq_mode_pop();
+      }
 
-  rdpq_sync_pipe();
-  rdpq_mode_push();
-  rdpq_mode_zbuf(false, false);
-
-  if (paused) {
-    if (!first_paused) {
-      rdpq_mode_push();
-      rdpq_set_fog_color(RGBA32(0xff, 0xff, 0xff, 0xc0));
-      rdpq_set_prim_color(RGBA32(0x00, 0x00, 0x00, 0xff));
-      rdpq_mode_combiner(RDPQ_COMBINER_FLAT);
-      rdpq_mode_blender(RDPQ_BLENDER_MULTIPLY_CONST);
-      rdpq_fill_rectangle(0, 0, 320, 240);
-      rdpq_mode_pop();
-
-      first_paused = display_surface;
-    }
-    else if (first_paused != display_surface) {
-      rdpq_mode_push();
-      rdpq_set_mode_copy(false);
-      rdpq_tex_blit(first_paused, 0, 0, NULL);
-      rdpq_mode_pop();
+      textcache_queue(&banner_params, FONT_BANNER, 0, 60, "PAUSED");
+
+      rdpq_textparms_t params = {
+        .width = 300,
+        .height = 130,
+        .wrap = WRAP_WORD,
+      };
+
+      textcache_queuef(&params,
+          FONT_NORMAL,
+          10,
+          85,
+          "%s by %s\n\n%s\n\n%s",
+          minigame_def.gamename,
+          minigame_def.developername,
+          minigame_def.description,
+          minigame_def.instructions);
+
+      textcache_queuef(NULL,
+          FONT_NORMAL,
+          40,
+          215,
+          "%sRESUME",
+          paused_selection? SW_NORMAL_S : SW_SELECTED_S);
+      textcache_queuef(NULL,
+          FONT_NORMAL,
+          40+160,
+          215,
+          "%sQUIT",
+          !paused_selection? SW_NORMAL_S : SW_SELECTED_S);
+
+      draw_text_queue();
+
+      pause_dirty = false;
+      core_set_staticframe(true);
     }
 
-    MITIGATE_FONT_BUG;
-    rdpq_text_print(&banner_params, FONT_BANNER, 0, 60, "PAUSED");
-
-    rdpq_textparms_t params = {
-      .width = 300,
-      .height = 130,
-      .wrap = WRAP_WORD,
-    };
-
-    MITIGATE_FONT_BUG;
-    rdpq_text_printf(&params,
-        FONT_NORMAL,
-        10,
-        85,
-        "%s by %s\n\n%s\n\n%s",
-        minigame_def.gamename,
-        minigame_def.developername,
-        minigame_def.description,
-        minigame_def.instructions);
-
-    MITIGATE_FONT_BUG;
-    rdpq_text_printf(NULL,
-        FONT_NORMAL,
-        40,
-        215,
-        "%sRESUME",
-        paused_selection? SW_NORMAL_S : SW_SELECTED_S);
-    MITIGATE_FONT_BUG;
-    rdpq_text_printf(NULL,
-        FONT_NORMAL,
-        40+160,
-        215,
-        "%sQUIT",
-        !paused_selection? SW_NORMAL_S : SW_SELECTED_S);
-  }
+    draw_queue_flush();
+    rdpq_mode_pop();
 
-  rdpq_mode_pop();
-
-  rdpq_detach_show();
+    rdpq_detach_show();
+  }
 
   if (current_subgame->dynamic_loop_post && !paused) {
     current_subgame->dynamic_loop_post(delta_time);
@@ -369,6 +373,8 @@ void minigame_loop(float delta_time) {
         paused_controller = core_get_playercontroller(i);
         paused_selection = 0;
         paused = true;
+        pause_dirty = true;
+        input_clear();
         mixer_set_vol(.2f);
         break;
       }
@@ -379,11 +385,13 @@ void minigame_loop(float delta_time) {
     int axis = joypad_get_axis_pressed(paused_controller, JOYPAD_AXIS_STICK_X);
     if (pressed.start || pressed.b || (pressed.a && !paused_selection)) {
       paused = false;
+      core_set_staticframe(false);
       mixer_set_vol(1.f);
     } else if (pressed.a) {
       minigame_end();
     } else if (pressed.d_left || axis || pressed.d_right) {
       paused_selection ^= 1;
+      pause_dirty = true;
     }
   }
 }
@@ -392,6 +400,7 @@ void minigame_cleanup() {
   rspq_wait();
 
   rspq_block_free(empty_hud_block);
+  hud_free();
 
   if (current_subgame->cleanup) {
     current_subgame->cleanup();
@@ -415,8 +424,10 @@ void minigame_cleanup() {
     entity_free(&players[i].e);
     skeleton_free(&players[i].s);
   }
+  uniform_block_free(&player_block);
   t3d_model_free(player_model);
 
+  transforms_free();
   tpx_destroy();
   t3d_destroy();
   display_close();
@@ -4,7 +4,6 @@ ASSETS_LIST += \
 	filesystem/avanto/skin.sprite \
 	filesystem/avanto/ukko.t3dm \
 	filesystem/avanto/ukko-skin.sprite \
-	filesystem/avanto/loyly.wav64 \
 	filesystem/avanto/sj-polkka.xm64 \
 	filesystem/avanto/banner.font64 \
 	filesystem/avanto/timer.font64 \
@@ -21,21 +20,21 @@ ASSETS_LIST += \
 	filesystem/avanto/planks-gs.sprite \
 	filesystem/avanto/water-bg.sprite \
 	filesystem/avanto/finish.sprite \
-	filesystem/avanto/splash.wav64 \
 	filesystem/avanto/map.t3dm \
-	filesystem/avanto/tail.sprite \
-	filesystem/avanto/balloon.sprite \
-	filesystem/avanto/penalty.sprite \
+	filesystem/avanto/map.slabs \
+	filesystem/avanto/ui-atlas.sprite \
+	filesystem/avanto/ui-atlas.rects \
 	filesystem/avanto/shadow.t3dm \
 	filesystem/avanto/shadow.sprite \
 	filesystem/avanto/kiuas.sprite \
 	filesystem/avanto/unit-cube.t3dm
 
-AVANTO_AUDIOCONV_FLAGS += --wav-mono --wav-resample 22050 --wav-compress 3
+AVANTO_AUDIOCONV_FLAGS += --wav-mono --wav-resample 22050
+$(FILESYSTEM_DIR)/avanto/%.wav64: WAV_COMPRESS = 3
 $(FILESYSTEM_DIR)/avanto/%.wav64: $(ASSETS_DIR)/avanto/%.mp3
 	@mkdir -p $(dir $@)
 	@echo "    [AVANTO MP3 SFX] $@"
-	$(N64_AUDIOCONV) $(AVANTO_AUDIOCONV_FLAGS) -o $(dir $@) "$<"
+	$(N64_AUDIOCONV) $(AVANTO_AUDIOCONV_FLAGS) $(WAV_COMPRESS_FLAGS) -o $(dir $@) "$<"
 
 AVANTO_MKSPRITE_FLAGS=-c 3
 $(FILESYSTEM_DIR)/avanto/%.sprite: $(ASSETS_DIR)/avanto/%.png
@@ -43,6 +42,47 @@ $(FILESYSTEM_DIR)/avanto/%.sprite: $(ASSETS_DIR)/avanto/%.png
 	@echo "    [AVANTO SPRITE] $@"
 	$(N64_MKSPRITE) $(AVANTO MKSPRITE_FLAGS) -o $(dir $@) "$<"
 
+# Icons drawn together are packed into one atlas, in the order they are
+# layered, so they can share TMEM uploads
+AVANTO_UI_ATLAS_LIST = \
+	$(ASSETS_DIR)/avanto/balloon.png \
+	$(ASSETS_DIR)/avanto/tail.png \
+	$(ASSETS_DIR)/core/AButton.png \
+	$(ASSETS_DIR)/core/BButton.png \
+	$(ASSETS_DIR)/core/CUp.png \
+	$(ASSETS_DIR)/core/CDown.png \
+	$(ASSETS_DIR)/core/CLeft.png \
+	$(ASSETS_DIR)/core/CRight.png \
+	$(ASSETS_DIR)/core/DUp.png \
+	$(ASSETS_DIR)/core/DDown.png \
+	$(ASSETS_DIR)/core/DLeft.png \
+	$(ASSETS_DIR)/core/DRight.png \
+	$(ASSETS_DIR)/core/LTrigger.png \
+	$(ASSETS_DIR)/core/RTrigger.png \
+	$(ASSETS_DIR)/core/ZTrigger.png \
+	$(ASSETS_DIR)/avanto/penalty.png
+
+$(FILESYSTEM_DIR)/avanto/ui-atlas.sprite: $(AVANTO_UI_ATLAS_LIST) $(MINIGAME_DIR)/avanto/mkatlas.py
+	@mkdir -p $(dir $@) $(BUILD_DIR)/avanto
+	@echo "    [AVANTO ATLAS] $@"
+	python3 $(MINIGAME_DIR)/avanto/mkatlas.py 64 $(BUILD_DIR)/avanto/ui-atlas.png $(FILESYSTEM_DIR)/avanto/ui-atlas.rects $(AVANTO_UI_ATLAS_LIST)
+	$(N64_MKSPRITE) -f RGBA16 -o $(dir $@) $(BUILD_DIR)/avanto/ui-atlas.png
+
+$(FILESYSTEM_DIR)/avanto/ui-atlas.rects: $(FILESYSTEM_DIR)/avanto/ui-atlas.sprite
+
+# The lake map is cut into slabs along the track so the parts behind the
+# camera can be culled. The split model is written next to the original so
+# the texture paths it refers to still resolve
+AVANTO_MAP_SLAB_SIZE = 16
+$(FILESYSTEM_DIR)/avanto/map.t3dm: $(ASSETS_DIR)/avanto/map.glb $(MINIGAME_DIR)/avanto/mkslabs.py
+	@mkdir -p $(dir $@)
+	@echo "    [AVANTO MAP] $@"
+	python3 $(MINIGAME_DIR)/avanto/mkslabs.py $(AVANTO_MAP_SLAB_SIZE) 64 "$<" $(ASSETS_DIR)/avanto/map-slabs.glb $(FILESYSTEM_DIR)/avanto/map.slabs
+	$(T3D_GLTF_TO_3D) $(T3DM_FLAGS) $(ASSETS_DIR)/avanto/map-slabs.glb $@
+	$(N64_BINDIR)/mkasset -c 2 -o $(dir $@) $@
+
+$(FILESYSTEM_DIR)/avanto/map.slabs: $(FILESYSTEM_DIR)/avanto/map.t3dm
+
 $(FILESYSTEM_DIR)/avanto/banner.font64: $(ASSETS_DIR)/squarewave.ttf
 	@mkdir -p $(dir $@)
 	@echo "    [AVANTO FONT] $@"
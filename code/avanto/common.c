@@ -1,6 +1,10 @@
 #include <libdragon.h>
 #include "../../minigame.h"
 #include "../../core.h"
+#include "../../textcache.h"
+#include "../../sfxbank.h"
+#include "../../renderstats.h"
+#include "../../matrixpool.h"
 #include <t3d/t3d.h>
 #include <t3d/t3dmodel.h>
 #include <t3d/t3dskeleton.h>
@@ -22,7 +26,15 @@ const char *const PLAYER_TITLES[] = {
   SW_PLAYER4_S "P4",
 };
 
+static joypad_buttons_t latched_pressed[4][INPUT_QUEUE_LEN];
+static size_t latched_count[4];
+static bool frame_latched;
 static bool script_signals[SCRIPT_NUM_SIGNALS];
+static struct hud_layer hud_layer;
+static struct hud_layer timer_layer;
+static int hud_bar_widths[4];
+static bool hud_outs[4];
+static int hud_timer_value;
 
 float get_ground_height(float z, struct ground *ground) {
   float height = 0;
@@ -78,21 +90,54 @@ void skeleton_free(struct skeleton *s) {
   t3d_skeleton_destroy(&s->skeleton);
 }
 
+static MatrixPool transform_pool;
+// Matrices rewritten every frame get a copy per frame, so the CPU never
+// writes the one the RSP may still be reading. There is one per framebuffer,
+// as display_get only hands out the one of a frame the RDP has finished
+static MatrixPool frame_transform_pool;
+
+void transforms_init() {
+  matrixpool_init(&transform_pool, MAX_TRANSFORMS, 1);
+  matrixpool_init(&frame_transform_pool, MAX_FRAME_TRANSFORMS,
+      NUM_FRAMEBUFFERS);
+}
+
+void transforms_free() {
+  matrixpool_free(&transform_pool);
+  matrixpool_free(&frame_transform_pool);
+}
+
+// Call once per frame, after every moving entity and particle source got its
+// frame transform and before any of them is drawn
+void flush_frame_transforms() {
+  matrixpool_flush(&frame_transform_pool);
+}
+
+T3DMat4FP *alloc_transform() {
+  return matrixpool_alloc(&transform_pool);
+}
+
+void free_transform(T3DMat4FP *transform) {
+  matrixpool_release(&transform_pool, transform);
+}
+
 void entity_init(struct entity *e,
     const T3DModel *model,
     const T3DVec3 *scale,
     const T3DVec3 *rotation,
     const T3DVec3 *pos,
     T3DSkeleton *skeleton,
-    T3DModelDrawConf *draw_conf) {
+    T3DModelDrawConf *draw_conf,
+    const struct block_uniform *uniforms,
+    size_t num_uniforms) {
 
   e->model = model;
-  e->transform = malloc_uncached(sizeof(T3DMat4FP));
+  e->transform = alloc_transform();
   t3d_mat4fp_from_srt_euler(e->transform, scale->v, rotation->v, pos->v);
+  e->frame_transform = e->transform;
+  e->moving = false;
   e->skeleton = skeleton;
-
-  rspq_block_begin();
-  t3d_matrix_push(e->transform);
+  e->instance_of = NULL;
 
   T3DModelDrawConf dummy_conf;
   memset(&dummy_conf, 0, sizeof(dummy_conf));
@@ -106,15 +151,232 @@ void entity_init(struct entity *e,
   else {
     draw_conf->matrices = NULL;
   }
-  t3d_model_draw_custom(e->model, *draw_conf);
+  uniform_block_init(&e->block,
+      e->model,
+      e->transform,
+      *draw_conf,
+      uniforms,
+      num_uniforms);
+}
+
+// Shares a block made by instanced_block_init, the transform and bones are
+// bound every time it is drawn instead of being recorded. The transform is
+// written every frame through entity_get_frame_transform, before
+// flush_frame_transforms
+void entity_init_moving(struct entity *e,
+    const struct uniform_block *block,
+    T3DSkeleton *skeleton) {
+  e->model = NULL;
+  e->transform = matrixpool_alloc(&frame_transform_pool);
+  e->frame_transform = e->transform;
+  e->moving = true;
+  e->skeleton = skeleton;
+  e->instance_of = block;
+}
+
+T3DMat4FP *entity_get_frame_transform(struct entity *e) {
+  assertf(e->moving, "Only moving entities have a transform per frame");
+  e->frame_transform = matrixpool_get(&frame_transform_pool, e->transform);
+  return e->frame_transform;
+}
 
+void entity_draw(const struct entity *e, const union uniform_value *values) {
+  if (!e->instance_of) {
+    uniform_block_run(&e->block, values);
+    return;
+  }
+
+  t3d_matrix_push(e->frame_transform);
+  if (e->skeleton) {
+    t3d_segment_set(T3D_SEGMENT_SKELETON, e->skeleton->boneMatricesFP);
+  }
+  uniform_block_run(e->instance_of, values);
   t3d_matrix_pop(1);
-  e->display_block = rspq_block_end();
 }
 
 void entity_free(struct entity *e) {
-  free_uncached(e->transform);
-  rspq_block_free(e->display_block);
+  if (e->moving) {
+    matrixpool_release(&frame_transform_pool, e->transform);
+  }
+  else {
+    free_transform(e->transform);
+  }
+  if (!e->instance_of) {
+    uniform_block_free(&e->block);
+  }
+}
+
+struct uniform_filter {
+  T3DModelDrawConf *draw_conf;
+  const struct block_uniform *uniforms;
+  size_t num_uniforms;
+};
+
+static bool filter_out_uniforms(void *user_data, const T3DObject *object) {
+  struct uniform_filter *filter = (struct uniform_filter *) user_data;
+  for (size_t i = 0; i < filter->num_uniforms; i++) {
+    if (!strcmp(filter->uniforms[i].object, object->name)) {
+      return false;
+    }
+  }
+  return !filter->draw_conf->filterCb
+    || filter->draw_conf->filterCb(filter->draw_conf->userData, object);
+}
+
+static T3DObject *find_object(const T3DModel *model, const char *name) {
+  T3DModelIter it = t3d_model_iter_create(model, T3D_CHUNK_TYPE_OBJECT);
+  while (t3d_model_iter_next(&it)) {
+    if (!strcmp(name, it.object->name)) {
+      return it.object;
+    }
+  }
+  assertf(false, "Object %s not in model", name);
+  return NULL;
+}
+
+// The model is recorded into one block per uniform plus one. Everything
+// that does not take a uniform goes in the first part, then each uniform
+// object has its material at the end of one part and its triangles at the
+// start of the next, so the value can be set in between at run time
+void uniform_block_init(struct uniform_block *block,
+    const T3DModel *model,
+    const T3DMat4FP *transform,
+    T3DModelDrawConf draw_conf,
+    const struct block_uniform *uniforms,
+    size_t num_uniforms) {
+  assertf(num_uniforms <= MAX_BLOCK_UNIFORMS, "Too many uniforms");
+  block->num_uniforms = num_uniforms;
+
+  struct uniform_filter filter = {
+    .draw_conf = &draw_conf,
+    .uniforms = uniforms,
+    .num_uniforms = num_uniforms,
+  };
+  T3DModelDrawConf rest_conf = draw_conf;
+  rest_conf.userData = &filter;
+  rest_conf.filterCb = filter_out_uniforms;
+
+  rspq_block_begin();
+  if (transform) {
+    t3d_matrix_push(transform);
+  }
+  t3d_model_draw_custom(model, rest_conf);
+
+  for (size_t i = 0; i < num_uniforms; i++) {
+    T3DObject *object = find_object(model, uniforms[i].object);
+    block->types[i] = uniforms[i].type;
+    block->tile_sizes[i][0] = object->material->textureA.s.height;
+    block->tile_sizes[i][1] = object->material->textureA.t.height;
+
+    t3d_model_draw_material(object->material, NULL);
+    block->parts[i] = rspq_block_end();
+
+    rspq_block_begin();
+    t3d_model_draw_object(object, draw_conf.matrices);
+  }
+
+  if (transform) {
+    t3d_matrix_pop(1);
+  }
+  block->parts[num_uniforms] = rspq_block_end();
+}
+
+void instanced_block_init(struct uniform_block *block,
+    const T3DModel *model,
+    bool skinned,
+    const struct block_uniform *uniforms,
+    size_t num_uniforms) {
+  T3DModelDrawConf draw_conf = {
+    .matrices = skinned?
+      (const T3DMat4FP*) t3d_segment_placeholder(T3D_SEGMENT_SKELETON)
+      : NULL,
+  };
+  uniform_block_init(block, model, NULL, draw_conf, uniforms, num_uniforms);
+}
+
+void uniform_block_run(const struct uniform_block *block,
+    const union uniform_value *values) {
+  for (size_t i = 0; i < block->num_uniforms; i++) {
+    rspq_block_run(block->parts[i]);
+
+    switch (block->types[i]) {
+      case UNIFORM_PRIM_COLOR:
+        rdpq_set_prim_color(values[i].color);
+        break;
+      case UNIFORM_TILE_OFFSET: {
+        float w = block->tile_sizes[i][0];
+        float h = block->tile_sizes[i][1];
+        float s = fm_fmodf(values[i].offset[0], w);
+        float t = fm_fmodf(values[i].offset[1], h);
+        s = s < 0.f? s + w : s;
+        t = t < 0.f? t + h : t;
+        rdpq_set_tile_size_fx(TILE0, s*4.f, t*4.f, (s + w)*4.f, (t + h)*4.f);
+        break;
+      }
+    }
+  }
+  rspq_block_run(block->parts[block->num_uniforms]);
+}
+
+void uniform_block_free(struct uniform_block *block) {
+  for (size_t i = 0; i <= block->num_uniforms; i++) {
+    rspq_block_free(block->parts[i]);
+  }
+}
+
+// The controllers are read once per frame, right before the ticks. Each tick
+// takes the presses of one frame, oldest first, so the others don't repeat
+// them and presses from frames that run no ticks aren't merged together
+static void input_latch() {
+  for (size_t i = 0; i < core_get_playercount(); i++) {
+    joypad_buttons_t pressed =
+      joypad_get_buttons_pressed(core_get_playercontroller(i));
+    if (!pressed.raw) {
+      continue;
+    }
+    if (latched_count[i] == INPUT_QUEUE_LEN) {
+      latched_pressed[i][INPUT_QUEUE_LEN - 1].raw |= pressed.raw;
+    }
+    else {
+      latched_pressed[i][latched_count[i]++] = pressed;
+    }
+  }
+}
+
+void input_end_frame() {
+  if (!frame_latched) {
+    input_latch();
+  }
+  frame_latched = false;
+}
+
+void input_clear() {
+  for (size_t i = 0; i < 4; i++) {
+    latched_count[i] = 0;
+  }
+  frame_latched = false;
+}
+
+void input_take(struct tick_input *input) {
+  if (!frame_latched) {
+    input_latch();
+    frame_latched = true;
+  }
+  for (size_t i = 0; i < 4; i++) {
+    input->pressed[i].raw = 0;
+    if (latched_count[i]) {
+      input->pressed[i] = latched_pressed[i][0];
+      latched_count[i]--;
+      for (size_t j = 0; j < latched_count[i]; j++) {
+        latched_pressed[i][j] = latched_pressed[i][j + 1];
+      }
+    }
+    input->held[i].raw = 0;
+    if (i < core_get_playercount()) {
+      input->held[i] =
+        joypad_get_buttons_held(core_get_playercontroller(i));
+    }
+  }
 }
 
 void script_reset_signals() {
@@ -222,7 +484,7 @@ bool script_update(struct script_state *state, float delta_time) {
       }
     }
     else if (state->action->type == ACTION_PLAY_SFX) {
-      wav64_play(state->action->sfx, state->action->channel);
+      sfxbank_play(state->action->sfx, state->action->priority, .5f);
     }
     else if (state->action->type == ACTION_START_XM64) {
       xm64player_play(state->action->xm64, state->action->first_channel);
@@ -324,35 +586,114 @@ rspq_block_t *build_empty_hud_block() {
   return rspq_block_end();
 }
 
+static void hud_layer_init(struct hud_layer *layer,
+    int x,
+    int y,
+    int w,
+    int h) {
+  layer->surface = surface_alloc(FMT_RGBA16, w, h);
+  layer->x = x;
+  layer->y = y;
+  layer->valid = false;
+}
+
+static void hud_layer_blit(const struct draw_item *item) {
+  const struct hud_layer *layer = (const struct hud_layer *) item->data;
+  rstat_tex_blit("hud layer", &layer->surface, layer->x, layer->y, NULL);
+}
+
+static void hud_layer_draw(const struct hud_layer *layer) {
+  draw_queue_add(PASS_HUD,
+      DRAW_MODE_SPRITES,
+      &layer->surface,
+      hud_layer_blit,
+      layer);
+}
+
+void hud_init() {
+  hud_layer_init(&hud_layer, 0, 0, 320, HUD_LAYER_HEIGHT);
+  hud_layer_init(&timer_layer,
+      TIMER_LAYER_X,
+      TIMER_LAYER_Y,
+      TIMER_LAYER_WIDTH,
+      TIMER_LAYER_HEIGHT);
+}
+
+void hud_free() {
+  surface_free(&hud_layer.surface);
+  surface_free(&timer_layer.surface);
+}
+
+// The HUD only changes when a bar grows by a pixel or someone passes out, so
+// it is kept in its own surface and only redrawn then
 void draw_hud() {
   const color_t BAR_COLOR = RGBA32(0xff, 0x45, 0x00, 0xff);
 
-  rspq_block_run(empty_hud_block);
-
-  rdpq_mode_push();
-  rdpq_mode_zbuf(false, false);
+  bool changed = !hud_layer.valid;
+  int max_w = HUD_INDIVIDUAL_H_SPACE - HUD_BAR_X_OFFSET*2 - 2;
   for (size_t i = 0; i < 4; i++) {
-    int y = HUD_VERTICAL_BORDER;
-    int x = HUD_HORIZONTAL_BORDER + i*HUD_INDIVIDUAL_H_SPACE;
-    int mid_x = x + HUD_INDIVIDUAL_H_SPACE/2;
-
-    x += HUD_BAR_X_OFFSET + 1;
-    y += HUD_BAR_Y_OFFSET + 1;
-    int max_w = HUD_INDIVIDUAL_H_SPACE - HUD_BAR_X_OFFSET*2 - 2;
-    int h = HUD_BAR_HEIGHT - 2;;
     int w = (int) roundf((float) max_w * players[i].temperature);
     if (w > max_w) {
       w = max_w;
     }
-    rdpq_set_mode_fill(BAR_COLOR);
-    rdpq_fill_rectangle(x, y, x+w, y+h);
+    if (w != hud_bar_widths[i] || players[i].out != hud_outs[i]) {
+      hud_bar_widths[i] = w;
+      hud_outs[i] = players[i].out;
+      changed = true;
+    }
+  }
 
-    if (players[i].out) {
-      MITIGATE_FONT_BUG;
-      rdpq_text_print(NULL, FONT_NORMAL, mid_x-8, y+10, SW_OUT_S "OUT");
+  if (changed) {
+    rdpq_attach_clear(&hud_layer.surface, NULL);
+    rspq_block_run(empty_hud_block);
+    // One push and two fills per player, recorded in the block
+    rstat_count("empty hud", RSTAT_MODE_PUSH);
+    rstat_add("empty hud", RSTAT_MODE_SET, 4*2);
+
+    rstat_mode_push("hud");
+    rdpq_mode_zbuf(false, false);
+    for (size_t i = 0; i < 4; i++) {
+      int y = HUD_VERTICAL_BORDER;
+      int x = HUD_HORIZONTAL_BORDER + i*HUD_INDIVIDUAL_H_SPACE;
+      int mid_x = x + HUD_INDIVIDUAL_H_SPACE/2;
+
+      x += HUD_BAR_X_OFFSET + 1;
+      y += HUD_BAR_Y_OFFSET + 1;
+      int h = HUD_BAR_HEIGHT - 2;
+      rstat_set_mode_fill("hud", BAR_COLOR);
+      rdpq_fill_rectangle(x, y, x+hud_bar_widths[i], y+h);
+
+      if (hud_outs[i]) {
+        MITIGATE_FONT_BUG;
+        textcache_print(NULL, FONT_NORMAL, mid_x-8, y+10, SW_OUT_S "OUT");
+      }
     }
+    rdpq_mode_pop();
+    rdpq_detach();
+    hud_layer.valid = true;
   }
-  rdpq_mode_pop();
+
+  hud_layer_draw(&hud_layer);
+}
+
+void draw_timer(float time_left) {
+  int value = (int) ceilf(time_left);
+  if (!timer_layer.valid || value != hud_timer_value) {
+    float w = textcache_get_int_width(FONT_TIMER, SW_TIMER, value);
+
+    rdpq_attach_clear(&timer_layer.surface, NULL);
+    MITIGATE_FONT_BUG;
+    textcache_print_int(FONT_TIMER,
+      SW_TIMER,
+      (TIMER_LAYER_WIDTH - w)/2.f,
+      TIMER_Y - TIMER_LAYER_Y,
+      value);
+    rdpq_detach();
+    hud_timer_value = value;
+    timer_layer.valid = true;
+  }
+
+  hud_layer_draw(&timer_layer);
 }
 
 static void particle_source_init_steam(struct particle_source *source) {
@@ -429,7 +770,10 @@ void particle_source_init(struct particle_source *source,
   source->_meta = NULL;
   source->_particles = malloc_uncached(
       sizeof(TPXParticle) * (source->_num_allocated_particles/2));
-  source->_transform = malloc_uncached(sizeof(T3DMat4FP));
+  source->_transform = alloc_transform();
+  source->_frame_transform = source->_transform;
+  source->_moving = false;
+  source->particle_x_scale = 1.f;
 
   if (type != SNOW) {
     source->_meta = malloc(
@@ -452,6 +796,19 @@ void particle_source_init(struct particle_source *source,
   }
 }
 
+// Like particle_source_init, but the transform has a copy per frame, so
+// particle_source_update_transform must be called every frame the source is
+// drawn, before flush_frame_transforms
+void particle_source_init_moving(struct particle_source *source,
+    size_t num_particles,
+    int type) {
+  particle_source_init(source, num_particles, type);
+  free_transform(source->_transform);
+  source->_transform = matrixpool_alloc(&frame_transform_pool);
+  source->_frame_transform = source->_transform;
+  source->_moving = true;
+}
+
 void particle_source_reset_steam(struct particle_source *source) {
   for (size_t i = 0; i < source->_num_allocated_particles/2; i++) {
     source->_particles[i].sizeA = 0;
@@ -513,7 +870,12 @@ void particle_source_free(struct particle_source *source) {
     source->_particles = NULL;
   }
   if (source->_transform) {
-    free_uncached(source->_transform);
+    if (source->_moving) {
+      matrixpool_release(&frame_transform_pool, source->_transform);
+    }
+    else {
+      free_transform(source->_transform);
+    }
     source->_transform = NULL;
   }
   if (source->_meta) {
@@ -658,7 +1020,11 @@ static void particle_source_iterate_splash(struct particle_source *source,
 }
 
 void particle_source_update_transform(struct particle_source *source) {
-  t3d_mat4fp_from_srt_euler(source->_transform,
+  if (source->_moving) {
+    source->_frame_transform =
+      matrixpool_get(&frame_transform_pool, source->_transform);
+  }
+  t3d_mat4fp_from_srt_euler(source->_frame_transform,
       source->scale.v,
       source->rot.v,
       source->pos.v);
@@ -685,26 +1051,289 @@ void particle_source_iterate(struct particle_source *source,
 }
 
 void particle_source_draw(const struct particle_source *source) {
-  tpx_matrix_push(source->_transform);
+  tpx_matrix_push(source->_frame_transform);
   tpx_particle_draw(source->_particles, source->_num_allocated_particles);
   tpx_matrix_pop(1);
 }
 
+static void particle_source_draw_scaled(const struct draw_item *item) {
+  const struct particle_source *source =
+    (const struct particle_source *) item->data;
+  tpx_state_set_scale(source->particle_x_scale, 1.f);
+  particle_source_draw(source);
+}
+
+void particle_source_queue(const struct particle_source *source) {
+  draw_queue_add(PASS_PARTICLES,
+      DRAW_MODE_PARTICLES,
+      NULL,
+      particle_source_draw_scaled,
+      source);
+}
+
 float rand_float(float min, float max) {
   float r = (float) rand() / (float) RAND_MAX;
   return r*(max-min) + min;
 }
 
+static struct draw_item draw_queue[DRAW_QUEUE_SIZE];
+static size_t draw_queue_len;
+
+static void enter_particles_mode() {
+  rstat_set_mode_standard("draw queue");
+  rdpq_mode_zbuf(true, true);
+  rdpq_mode_zoverride(true, 0, 0);
+  rdpq_mode_combiner(RDPQ_COMBINER_FLAT);
+  rdpq_mode_blender(RDPQ_BLENDER_MULTIPLY);
+  tpx_state_from_t3d();
+}
+
+// The atlas and the HUD layers only use 1-bit alpha, so they can share a
+// mode
+static void enter_sprites_mode() {
+  rstat_set_mode_standard("draw queue");
+  rdpq_mode_alphacompare(1);
+}
+
+// The fonts set up the rest of the mode themselves
+static void enter_text_mode() {
+  rstat_set_mode_standard("draw queue");
+}
+
+static void enter_fill_mode() {
+  rstat_set_mode_fill("draw queue", RGBA32(0x0, 0x0, 0x0, 0xff));
+}
+
+static void (*const enter_draw_mode[NUM_DRAW_MODES])() = {
+  [DRAW_MODE_PARTICLES] = enter_particles_mode,
+  [DRAW_MODE_SPRITES] = enter_sprites_mode,
+  [DRAW_MODE_TEXT] = enter_text_mode,
+  [DRAW_MODE_FILL] = enter_fill_mode,
+};
+
+static int draw_item_cmp(const struct draw_item *a, const struct draw_item *b) {
+  if (a->pass != b->pass) {
+    return a->pass - b->pass;
+  }
+  if (a->mode != b->mode) {
+    return a->mode - b->mode;
+  }
+  if (a->texture != b->texture) {
+    return a->texture < b->texture? -1 : 1;
+  }
+  return 0;
+}
+
+void draw_queue_add(enum draw_pass pass,
+    enum draw_mode mode,
+    const void *texture,
+    void (*draw)(const struct draw_item *),
+    const void *data) {
+  assertf(draw_queue_len < DRAW_QUEUE_SIZE, "Draw queue is full");
+  draw_queue[draw_queue_len++] = (struct draw_item) {
+    .pass = pass,
+    .mode = mode,
+    .texture = texture,
+    .draw = draw,
+    .data = data,
+  };
+}
+
+// Stable, so items that compare equal keep the order they were added in
+void draw_queue_flush() {
+  for (size_t i = 1; i < draw_queue_len; i++) {
+    struct draw_item item = draw_queue[i];
+    size_t j = i;
+    for (; j > 0 && draw_item_cmp(&draw_queue[j-1], &item) > 0; j--) {
+      draw_queue[j] = draw_queue[j-1];
+    }
+    draw_queue[j] = item;
+  }
+
+  rstat_mode_push("draw queue");
+  rdpq_mode_zbuf(false, false);
+
+  // Autosync can't see the TMEM loads done by T3D and TPX, so wait for them
+  // before anything here loads textures
+  rstat_sync_load("draw queue");
+  int mode = -1;
+  for (size_t i = 0; i < draw_queue_len; i++) {
+    const struct draw_item *item = &draw_queue[i];
+    if (item->mode != mode) {
+      rstat_sync_pipe("draw queue");
+      enter_draw_mode[item->mode]();
+      mode = item->mode;
+    }
+    item->draw(item);
+  }
+  rstat_sync_pipe("draw queue");
+  rdpq_mode_pop();
+
+  draw_queue_len = 0;
+}
+
+static void draw_text_queue_cb(const struct draw_item *item) {
+  textcache_queue_flush();
+}
+
+void draw_text_queue() {
+  draw_queue_add(PASS_TEXT, DRAW_MODE_TEXT, NULL, draw_text_queue_cb, NULL);
+}
+
+static void draw_fade_cb(const struct draw_item *item) {
+  rdpq_fill_rectangle(item->rect[0],
+      item->rect[1],
+      item->rect[2],
+      item->rect[3]);
+}
+
 void draw_fade(float fade) {
   int w = roundf(fade*320);
   w = w > 320? 320 : w;
   int h = roundf(fade*240);
   h = h > 320? 320 : h;
-  int x = (320-w)/2;
-  int y = (240-h)/2;
-  rdpq_mode_push();
-  rdpq_mode_zbuf(false, false);
-  rdpq_set_mode_fill(RGBA32(0x0, 0x0, 0x0, 0xff));
-  rdpq_fill_rectangle(x, y, x+w, y+h);
-  rdpq_mode_pop();
+  draw_queue_add(PASS_OVERLAY, DRAW_MODE_FILL, NULL, draw_fade_cb, NULL);
+
+  // Kept in the item, so every fade queued in a frame has its own rectangle
+  struct draw_item *item = &draw_queue[draw_queue_len-1];
+  item->rect[0] = (320-w)/2;
+  item->rect[1] = (240-h)/2;
+  item->rect[2] = item->rect[0] + w;
+  item->rect[3] = item->rect[1] + h;
+}
+
+void atlas_load(struct atlas *atlas,
+    const char *sprite_path,
+    const char *rects_path) {
+  atlas->sprite = sprite_load(sprite_path);
+  atlas->surface = sprite_get_pixels(atlas->sprite);
+  assertf(surface_get_format(&atlas->surface) == FMT_RGBA16,
+      "Atlas %s must be RGBA16", sprite_path);
+
+  int size;
+  atlas->table = asset_load(rects_path, &size);
+  assertf(!memcmp(atlas->table->magic, "ATLS", 4),
+      "Invalid atlas rects %s", rects_path);
+  assertf(sizeof(struct atlas_table)
+      + atlas->table->num_rects*sizeof(struct atlas_rect) <= size,
+      "Truncated atlas rects %s", rects_path);
+}
+
+void atlas_free(struct atlas *atlas) {
+  free(atlas->table);
+  sprite_free(atlas->sprite);
+}
+
+const struct atlas_rect *atlas_find(const struct atlas *atlas,
+    const char *name) {
+  for (size_t i = 0; i < atlas->table->num_rects; i++) {
+    if (!strcmp(atlas->table->rects[i].name, name)) {
+      return &atlas->table->rects[i];
+    }
+  }
+  assertf(false, "Rect %s not in atlas", name);
+  return NULL;
+}
+
+void atlas_batch_begin(struct atlas_batch *batch,
+    const struct atlas *atlas,
+    const char *label) {
+  batch->atlas = atlas;
+  batch->label = label;
+  batch->num_blits = 0;
+}
+
+void atlas_batch_add(struct atlas_batch *batch,
+    const struct atlas_rect *rect,
+    int x,
+    int y,
+    bool flip_x) {
+  assertf(batch->num_blits < ATLAS_MAX_BLITS, "Atlas batch is full");
+  batch->blits[batch->num_blits++] = (struct atlas_blit) {
+    .rect = rect,
+    .x = x,
+    .y = y,
+    .flip_x = flip_x,
+  };
+}
+
+static size_t atlas_band_bytes(const struct atlas *atlas, int w, int h) {
+  int pitch = TEX_FORMAT_PIX2BYTES(surface_get_format(&atlas->surface), w);
+  return ((pitch + 7) & ~7) * h;
+}
+
+// The atlas is packed in layering order, so sorting by row keeps overlapping
+// blits in order while letting neighbours share a single TMEM upload
+void atlas_batch_draw(struct atlas_batch *batch) {
+  struct atlas_blit *blits = batch->blits;
+  size_t n = batch->num_blits;
+
+  for (size_t i = 1; i < n; i++) {
+    struct atlas_blit b = blits[i];
+    size_t j = i;
+    for (; j > 0 && blits[j-1].rect->y > b.rect->y; j--) {
+      blits[j] = blits[j-1];
+    }
+    blits[j] = b;
+  }
+
+  size_t start = 0;
+  while (start < n) {
+    const struct atlas_rect *r = blits[start].rect;
+    int s0 = r->x;
+    int t0 = r->y;
+    int s1 = r->x + r->w;
+    int t1 = r->y + r->h;
+
+    size_t end = start + 1;
+    for (; end < n; end++) {
+      r = blits[end].rect;
+      int ns0 = r->x < s0? r->x : s0;
+      int nt0 = r->y < t0? r->y : t0;
+      int ns1 = r->x + r->w > s1? r->x + r->w : s1;
+      int nt1 = r->y + r->h > t1? r->y + r->h : t1;
+      if (atlas_band_bytes(batch->atlas, ns1-ns0, nt1-nt0) > TMEM_SIZE) {
+        break;
+      }
+      s0 = ns0;
+      t0 = nt0;
+      s1 = ns1;
+      t1 = nt1;
+    }
+
+    rstat_tex_upload_sub(batch->label,
+        TILE0, &batch->atlas->surface, NULL, s0, t0, s1, t1);
+    for (size_t i = start; i < end; i++) {
+      const struct atlas_blit *b = &blits[i];
+      r = b->rect;
+      if (b->flip_x) {
+        rdpq_texture_rectangle_raw(TILE0,
+            b->x, b->y, b->x + r->w, b->y + r->h,
+            r->x + r->w - 1, r->y, -1.f, 1.f);
+      }
+      else {
+        rdpq_texture_rectangle(TILE0,
+            b->x, b->y, b->x + r->w, b->y + r->h,
+            r->x, r->y);
+      }
+    }
+
+    start = end;
+  }
+
+  batch->num_blits = 0;
+}
+
+static void atlas_batch_draw_cb(const struct draw_item *item) {
+  atlas_batch_draw((struct atlas_batch *) item->data);
+}
+
+// The batch is drawn when the draw queue is flushed, so it has to live
+// until then
+void atlas_batch_queue(struct atlas_batch *batch, enum draw_pass pass) {
+  draw_queue_add(pass,
+      DRAW_MODE_SPRITES,
+      &batch->atlas->surface,
+      atlas_batch_draw_cb,
+      batch);
 }
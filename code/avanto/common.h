@@ -1,6 +1,11 @@
 #define MAX_GROUND_CHANGES 6
 #define EPS 1e-6
 #define TIMER_Y 220
+#define TIMER_LAYER_X 112
+#define TIMER_LAYER_Y 176
+#define TIMER_LAYER_WIDTH 96
+#define TIMER_LAYER_HEIGHT 48
+#define HUD_LAYER_HEIGHT 48
 #define HUD_HORIZONTAL_BORDER 26
 #define HUD_VERTICAL_BORDER 26
 #define HUD_INDIVIDUAL_H_SPACE ((320 - HUD_HORIZONTAL_BORDER*2)/4)
@@ -11,13 +16,61 @@
 #define MAX_PARTICLE_SOURCES 4
 #define SCRIPT_NUM_SIGNALS 4
 #define FADE_TIME 1.f
+#define ATLAS_NAME_LEN 16
+#define ATLAS_MAX_BLITS 16
+#define TMEM_SIZE 4096
+#define MAX_BLOCK_UNIFORMS 2
+#define MAX_TRANSFORMS 32
+#define NUM_FRAMEBUFFERS 3
+#define MAX_FRAME_TRANSFORMS 16
+#define INPUT_QUEUE_LEN 4
+#define DRAW_QUEUE_SIZE 32
+#define NUM_MUSIC_CHANNELS 8
+#define MINIGAME_CHANNEL (SFXBANK_FIRST_CHANNEL+SFXBANK_VOICES)
+#define NUM_AUDIO_CHANNELS (MINIGAME_CHANNEL+1)
 #define MITIGATE_FONT_BUG {rdpq_sync_pipe(); rdpq_sync_tile();}
 
+enum sfx_priority {
+  SFX_PRIORITY_SPLASH,
+  SFX_PRIORITY_ACTION,
+};
+
+enum uniform_type {
+  UNIFORM_PRIM_COLOR,
+  UNIFORM_TILE_OFFSET,
+};
+
+struct block_uniform {
+  const char *object;
+  enum uniform_type type;
+};
+
+union uniform_value {
+  color_t color;
+  float offset[2];
+};
+
+struct uniform_block {
+  size_t num_uniforms;
+  enum uniform_type types[MAX_BLOCK_UNIFORMS];
+  float tile_sizes[MAX_BLOCK_UNIFORMS][2];
+  rspq_block_t *parts[MAX_BLOCK_UNIFORMS + 1];
+};
+
+enum player_uniforms {
+  PLAYER_UNIFORM_SKIN,
+  PLAYER_UNIFORM_HAIR,
+  NUM_PLAYER_UNIFORMS,
+};
+
 struct entity {
   const T3DModel *model;
   T3DMat4FP *transform;
+  T3DMat4FP *frame_transform;
+  bool moving;
   T3DSkeleton *skeleton;
-  rspq_block_t *display_block;
+  struct uniform_block block;
+  const struct uniform_block *instance_of;
 };
 
 struct skeleton {
@@ -33,6 +86,7 @@ struct camera {
 
 struct character {
   struct entity e;
+  union uniform_value uniforms[NUM_PLAYER_UNIFORMS];
   T3DVec3 pos;
   float rotation;
   float scale;
@@ -83,8 +137,8 @@ struct script_action {
     bool visibility;
     float time;
     struct {
-      wav64_t *sfx;
-      size_t channel;
+      const SfxSample *sfx;
+      enum sfx_priority priority;
     };
     struct {
       xm64player_t *xm64;
@@ -102,6 +156,11 @@ struct script_state {
   float time;
 };
 
+struct tick_input {
+  joypad_buttons_t pressed[4];
+  joypad_buttons_t held[4];
+};
+
 struct subgame {
   void (*dynamic_loop_pre)(float);
   void (*dynamic_loop_render)(float);
@@ -179,6 +238,31 @@ enum particle_type {
   SPLASH,
 };
 
+enum draw_pass {
+  PASS_PARTICLES,
+  PASS_UI,
+  PASS_HUD,
+  PASS_TEXT,
+  PASS_OVERLAY,
+};
+
+enum draw_mode {
+  DRAW_MODE_PARTICLES,
+  DRAW_MODE_SPRITES,
+  DRAW_MODE_TEXT,
+  DRAW_MODE_FILL,
+  NUM_DRAW_MODES,
+};
+
+struct draw_item {
+  uint8_t pass;
+  uint8_t mode;
+  const void *texture;
+  void (*draw)(const struct draw_item *);
+  const void *data;
+  int16_t rect[4];
+};
+
 struct particle_meta {
   union {
     struct {
@@ -193,11 +277,53 @@ struct particle_meta {
   };
 };
 
+struct hud_layer {
+  surface_t surface;
+  int x;
+  int y;
+  bool valid;
+};
+
+struct atlas_rect {
+  char name[ATLAS_NAME_LEN];
+  uint16_t x;
+  uint16_t y;
+  uint16_t w;
+  uint16_t h;
+};
+
+struct atlas_table {
+  char magic[4];
+  uint32_t num_rects;
+  struct atlas_rect rects[];
+};
+
+struct atlas {
+  sprite_t *sprite;
+  surface_t surface;
+  struct atlas_table *table;
+};
+
+struct atlas_blit {
+  const struct atlas_rect *rect;
+  int x;
+  int y;
+  bool flip_x;
+};
+
+struct atlas_batch {
+  const struct atlas *atlas;
+  const char *label;
+  size_t num_blits;
+  struct atlas_blit blits[ATLAS_MAX_BLITS];
+};
+
 struct particle_source {
   T3DVec3 pos;
   T3DVec3 rot;
   T3DVec3 scale;
   int8_t particle_size;
+  float particle_x_scale;
   bool render;
   bool paused;
 
@@ -227,6 +353,8 @@ struct particle_source {
 
   struct particle_meta *_meta;
   T3DMat4FP *_transform;
+  T3DMat4FP *_frame_transform;
+  bool _moving;
   TPXParticle *_particles;
   size_t _num_allocated_particles;
   size_t _type;
@@ -239,28 +367,87 @@ void skeleton_init(struct skeleton *s,
     const T3DModel *model,
     size_t num_anims);
 void skeleton_free(struct skeleton *s);
+void transforms_init();
+void transforms_free();
+T3DMat4FP *alloc_transform();
+void free_transform(T3DMat4FP *transform);
+void flush_frame_transforms();
 void entity_init(struct entity *e,
     const T3DModel *model,
     const T3DVec3 *scale,
     const T3DVec3 *rotation,
     const T3DVec3 *pos,
     T3DSkeleton *skeleton,
-    T3DModelDrawConf *draw_conf);
+    T3DModelDrawConf *draw_conf,
+    const struct block_uniform *uniforms,
+    size_t num_uniforms);
+void entity_init_moving(struct entity *e,
+    const struct uniform_block *block,
+    T3DSkeleton *skeleton);
+T3DMat4FP *entity_get_frame_transform(struct entity *e);
+void entity_draw(const struct entity *e, const union uniform_value *values);
 void entity_free(struct entity *e);
+void uniform_block_init(struct uniform_block *block,
+    const T3DModel *model,
+    const T3DMat4FP *transform,
+    T3DModelDrawConf draw_conf,
+    const struct block_uniform *uniforms,
+    size_t num_uniforms);
+void instanced_block_init(struct uniform_block *block,
+    const T3DModel *model,
+    bool skinned,
+    const struct block_uniform *uniforms,
+    size_t num_uniforms);
+void uniform_block_run(const struct uniform_block *block,
+    const union uniform_value *values);
+void uniform_block_free(struct uniform_block *block);
+void input_end_frame();
+void input_clear();
+void input_take(struct tick_input *input);
 void script_reset_signals();
 bool script_update(struct script_state *state, float delta_time);
+void hud_init();
+void hud_free();
 void draw_hud();
+void draw_timer(float time_left);
 rspq_block_t *build_empty_hud_block();
 void particle_source_init(struct particle_source *source,
     size_t num_particles,
     int type);
+void particle_source_init_moving(struct particle_source *source,
+    size_t num_particles,
+    int type);
 void particle_source_free(struct particle_source *source);
 void particle_source_iterate(struct particle_source *source,
     float delta_time);
 void particle_source_draw(const struct particle_source *source);
+void particle_source_queue(const struct particle_source *source);
 void particle_source_reset_steam(struct particle_source *source);
 void particle_source_reset_splash(struct particle_source *source,
     size_t num_particles);
 void particle_source_update_transform(struct particle_source *source);
 float rand_float(float min, float max);
+void draw_queue_add(enum draw_pass pass,
+    enum draw_mode mode,
+    const void *texture,
+    void (*draw)(const struct draw_item *),
+    const void *data);
+void draw_queue_flush();
+void draw_text_queue();
 void draw_fade(float fade);
+void atlas_load(struct atlas *atlas,
+    const char *sprite_path,
+    const char *rects_path);
+void atlas_free(struct atlas *atlas);
+const struct atlas_rect *atlas_find(const struct atlas *atlas,
+    const char *name);
+void atlas_batch_begin(struct atlas_batch *batch,
+    const struct atlas *atlas,
+    const char *label);
+void atlas_batch_add(struct atlas_batch *batch,
+    const struct atlas_rect *rect,
+    int x,
+    int y,
+    bool flip_x);
+void atlas_batch_draw(struct atlas_batch *batch);
+void atlas_batch_queue(struct atlas_batch *batch, enum draw_pass pass);
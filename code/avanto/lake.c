@@ -1,6 +1,10 @@
 #include <libdragon.h>
 #include "../../minigame.h"
 #include "../../core.h"
+#include "../../textcache.h"
+#include "../../sfxbank.h"
+#include "../../synth.h"
+#include "../../interp.h"
 #include <t3d/t3d.h>
 #include <t3d/t3dmodel.h>
 #include <t3d/t3dskeleton.h>
@@ -47,11 +51,14 @@
 #define NUM_SPLASH_SOURCES 4
 #define MIN_SPLASH_PARTICLES 8
 #define MAX_SPLASH_PARTICLES 16
-#define MINIGAME_CHANNEL 31
-#define FIRST_SPLASH_CHANNEL 8
 #define CHANCE_TO_SPLASH .1f
 #define SPLASH_INTERVAL .5f
 #define WATER_Y (-1.5f*64.f)
+#define SKY_COLOR RGBA32(0x00, 0xb5, 0xe2, 0xff)
+#define NEAR_PLANE 50.f
+#define FAR_PLANE 2600.f
+#define FOG_NEAR 1400.f
+#define MAX_MAP_SLABS 16
 
 enum lake_stages {
   LAKE_INTRO,
@@ -62,8 +69,26 @@ enum lake_stages {
   NUM_LAKE_STAGES,
 };
 
+struct map_slab_bounds {
+  float min[3];
+  float max[3];
+};
+
+struct map_slab_table {
+  char magic[4];
+  uint32_t num_slabs;
+  struct map_slab_bounds bounds[];
+};
+
+struct map_slab {
+  T3DVec3 min;
+  T3DVec3 max;
+  struct uniform_block block;
+  const char *water;
+};
+
 struct button {
-  sprite_t *sprite;
+  const struct atlas_rect *rect;
   uint16_t mask;
 };
 
@@ -86,15 +111,18 @@ extern wav64_t sfx_stop;
 extern wav64_t sfx_winner;
 extern const char *const PLAYER_TITLES[];
 extern struct rdpq_textparms_s banner_params;
-extern struct rdpq_textparms_s timer_params;
 extern xm64player_t music;
 extern struct camera cam;
 
-static struct entity map;
 static T3DModel *map_model;
+static T3DMat4FP *map_transform;
+static struct map_slab map_slabs[MAX_MAP_SLABS];
+static size_t num_map_slabs;
+static union uniform_value water_offset;
+static float water_tile_size[2];
+static struct uniform_block shadow_block;
 static struct entity shadows[4];
 static T3DModel *shadow_model;
-static T3DObject *water_object;
 static struct ground ground = {
   .num_changes = 6,
   .changes = {
@@ -108,14 +136,27 @@ static struct ground ground = {
 };
 static bool lake_stage_inited[NUM_LAKE_STAGES];
 static size_t lake_stage;
-static wav64_t sfx_splash[NUM_SPLASH_SOURCES];
+static const SynthPatch sfx_splash = {
+  .length = .6f,
+  .attack = .004f,
+  .decay = .12f,
+  .noise = .25f,
+  .lowpass = 3000.f,
+  .highpass = 150.f,
+  .variation = .2f,
+  .resonators = {
+    {.frequency = 450.f, .bandwidth = 120.f, .gain = 2.5f, .sweep = 1.8f},
+    {.frequency = 900.f, .bandwidth = 250.f, .gain = 1.2f, .sweep = 1.5f},
+    {.frequency = 1700.f, .bandwidth = 600.f, .gain = .6f, .sweep = 1.f},
+  },
+};
 static float penalties[4];
 static const struct button *next_buttons[4];
 static struct button buttons[NUM_BUTTONS];
-static sprite_t *penalty_sprite;
-static sprite_t *balloon_sprite;
-static sprite_t *tail_sprite;
-rdpq_blitparms_t tail_params;
+static struct atlas ui_atlas;
+static const struct atlas_rect *penalty_rect;
+static const struct atlas_rect *balloon_rect;
+static const struct atlas_rect *tail_rect;
 static uint8_t winners_mask;
 static char banner_str[32];
 static float min_time_before_exiting;
@@ -135,11 +176,9 @@ static void lake_outro_dynamic_loop(float delta_time);
 
 static void generate_splash(T3DVec3 pos, bool silent) {
   struct particle_source *source = NULL;
-  size_t index;
   for (size_t i = 0; i < NUM_SPLASH_SOURCES; i++) {
     if (splash_sources[i].paused) {
       source = &splash_sources[i];
-      index = i;
       break;
     }
   }
@@ -153,9 +192,8 @@ static void generate_splash(T3DVec3 pos, bool silent) {
 
   source->pos = pos;
   particle_source_reset_splash(source, num_particles);
-  particle_source_update_transform(source);
   if (!silent) {
-    wav64_play(&sfx_splash[index], FIRST_SPLASH_CHANNEL+index);
+    synth_play(&sfx_splash, SFX_PRIORITY_SPLASH, .5f);
   }
 }
 
@@ -234,11 +272,91 @@ static void update_cam(float z) {
       &(T3DVec3) {{0, 1, 0}});
 }
 
-bool filter_out_water(void *user_data, const T3DObject *object) {
-  if (!strcmp("water", object->name)) {
-    return false;
+static bool is_water(const T3DObject *object) {
+  return !strncmp("water.", object->name, 6);
+}
+
+static int get_slab(const T3DObject *object) {
+  const char *s = strstr(object->name, ".slab");
+  return s? atoi(s + 5) : -1;
+}
+
+bool filter_slab(void *user_data, const T3DObject *object) {
+  return get_slab(object) == *(int*) user_data;
+}
+
+static void load_map() {
+  map_model = t3d_model_load("load:/avanto/map.t3dm");
+  map_transform = alloc_transform();
+  t3d_mat4fp_from_srt_euler(map_transform,
+      (float[3]) {MAP_SCALE, MAP_SCALE, MAP_SCALE},
+      (float[3]) {0.f, 0.f, 0.f},
+      (float[3]) {0.f, 0.f, 0.f});
+
+  int size;
+  struct map_slab_table *table = asset_load("load:/avanto/map.slabs", &size);
+  assertf(!memcmp(table->magic, "SLAB", 4), "Invalid map slabs");
+  assertf(table->num_slabs <= MAX_MAP_SLABS, "Too many map slabs");
+  assertf(sizeof(struct map_slab_table)
+      + table->num_slabs*sizeof(struct map_slab_bounds) <= size,
+      "Truncated map slabs");
+
+  num_map_slabs = table->num_slabs;
+  for (int i = 0; i < num_map_slabs; i++) {
+    struct map_slab *slab = &map_slabs[i];
+    for (size_t j = 0; j < 3; j++) {
+      slab->min.v[j] = table->bounds[i].min[j]*MAP_SCALE;
+      slab->max.v[j] = table->bounds[i].max[j]*MAP_SCALE;
+    }
+    slab->water = NULL;
+  }
+  free(table);
+
+  T3DModelIter it = t3d_model_iter_create(map_model, T3D_CHUNK_TYPE_OBJECT);
+  while (t3d_model_iter_next(&it)) {
+    int slab = get_slab(it.object);
+    if (slab < 0 || !is_water(it.object)) {
+      continue;
+    }
+    assertf(slab < num_map_slabs, "%s out of range", it.object->name);
+    assertf(!map_slabs[slab].water, "Slab %d has more than one water", slab);
+    map_slabs[slab].water = it.object->name;
+  }
+
+  // The water scroll is patched in per frame, so it can stay in the block
+  for (int i = 0; i < num_map_slabs; i++) {
+    struct block_uniform water = {map_slabs[i].water, UNIFORM_TILE_OFFSET};
+    uniform_block_init(&map_slabs[i].block,
+        map_model,
+        map_transform,
+        (T3DModelDrawConf) {.userData = &i, .filterCb = filter_slab},
+        &water,
+        map_slabs[i].water? 1 : 0);
+  }
+
+  // Every water shares one texture, so the scroll can wrap by its size
+  water_tile_size[0] = water_tile_size[1] = 0.f;
+  for (int i = 0; i < num_map_slabs; i++) {
+    if (!map_slabs[i].water) {
+      continue;
+    }
+    const float *size = map_slabs[i].block.tile_sizes[0];
+    if (water_tile_size[0] < EPS) {
+      water_tile_size[0] = size[0];
+      water_tile_size[1] = size[1];
+    }
+    assertf(size[0] == water_tile_size[0] && size[1] == water_tile_size[1],
+        "Slab %d has a differently sized water texture", i);
+  }
+}
+
+static void free_map() {
+  for (size_t i = 0; i < num_map_slabs; i++) {
+    uniform_block_free(&map_slabs[i].block);
   }
-  return true;
+  num_map_slabs = 0;
+  free_transform(map_transform);
+  t3d_model_free(map_model);
 }
 
 static void load_buttons() {
@@ -246,67 +364,67 @@ static void load_buttons() {
 
   b.raw = 0;
   b.a = 1;
-  buttons[0].sprite = sprite_load("rom:/core/AButton.sprite");
+  buttons[0].rect = atlas_find(&ui_atlas, "AButton");
   buttons[0].mask = b.raw;
 
   b.raw = 0;
   b.b = 1;
-  buttons[1].sprite = sprite_load("rom:/core/BButton.sprite");
+  buttons[1].rect = atlas_find(&ui_atlas, "BButton");
   buttons[1].mask = b.raw;
 
   b.raw = 0;
   b.c_up = 1;
-  buttons[2].sprite = sprite_load("rom:/core/CUp.sprite");
+  buttons[2].rect = atlas_find(&ui_atlas, "CUp");
   buttons[2].mask = b.raw;
 
   b.raw = 0;
   b.c_down = 1;
-  buttons[3].sprite = sprite_load("rom:/core/CDown.sprite");
+  buttons[3].rect = atlas_find(&ui_atlas, "CDown");
   buttons[3].mask = b.raw;
 
   b.raw = 0;
   b.c_left = 1;
-  buttons[4].sprite = sprite_load("rom:/core/CLeft.sprite");
+  buttons[4].rect = atlas_find(&ui_atlas, "CLeft");
   buttons[4].mask = b.raw;
 
   b.raw = 0;
   b.c_right = 1;
-  buttons[5].sprite = sprite_load("rom:/core/CRight.sprite");
+  buttons[5].rect = atlas_find(&ui_atlas, "CRight");
   buttons[5].mask = b.raw;
 
   b.raw = 0;
   b.d_up = 1;
-  buttons[6].sprite = sprite_load("rom:/core/DUp.sprite");
+  buttons[6].rect = atlas_find(&ui_atlas, "DUp");
   buttons[6].mask = b.raw;
 
   b.raw = 0;
   b.d_down = 1;
-  buttons[7].sprite = sprite_load("rom:/core/DDown.sprite");
+  buttons[7].rect = atlas_find(&ui_atlas, "DDown");
   buttons[7].mask = b.raw;
 
   b.raw = 0;
   b.d_left = 1;
-  buttons[8].sprite = sprite_load("rom:/core/DLeft.sprite");
+  buttons[8].rect = atlas_find(&ui_atlas, "DLeft");
   buttons[8].mask = b.raw;
 
   b.raw = 0;
   b.d_right = 1;
-  buttons[9].sprite = sprite_load("rom:/core/DRight.sprite");
+  buttons[9].rect = atlas_find(&ui_atlas, "DRight");
   buttons[9].mask = b.raw;
 
   b.raw = 0;
   b.l = 1;
-  buttons[10].sprite = sprite_load("rom:/core/LTrigger.sprite");
+  buttons[10].rect = atlas_find(&ui_atlas, "LTrigger");
   buttons[10].mask = b.raw;
 
   b.raw = 0;
   b.r = 1;
-  buttons[11].sprite = sprite_load("rom:/core/RTrigger.sprite");
+  buttons[11].rect = atlas_find(&ui_atlas, "RTrigger");
   buttons[11].mask = b.raw;
 
   b.raw = 0;
   b.z = 1;
-  buttons[12].sprite = sprite_load("rom:/core/ZTrigger.sprite");
+  buttons[12].rect = atlas_find(&ui_atlas, "ZTrigger");
   buttons[12].mask = b.raw;
 }
 
@@ -322,42 +440,20 @@ void lake_init() {
   cam.target = (T3DVec3) {{FOCUS_X, FOCUS_Y, 0.f}};
   cam.pos = (T3DVec3) {{CAMERA_X, CAMERA_Y, 0.f}};
 
-  T3DModelDrawConf map_draw_conf = {
-    .userData = NULL,
-    .tileCb = NULL,
-    .filterCb = filter_out_water,
-    .dynTextureCb = NULL,
-    .matrices = NULL,
-  };
-  map_model = t3d_model_load("rom:/avanto/map.t3dm");
-  water_object = NULL;
-  T3DModelIter it = t3d_model_iter_create(map_model, T3D_CHUNK_TYPE_OBJECT);
-  while (t3d_model_iter_next(&it)) {
-    if (!strcmp("water", it.object->name)) {
-      water_object = it.object;
-      break;
-    }
-  }
-  entity_init(&map,
-      map_model,
-      &(T3DVec3) {{MAP_SCALE, MAP_SCALE, MAP_SCALE}},
-      &(T3DVec3) {{0.f, 0.f, 0.f}},
-      &(T3DVec3) {{0.f, 0.f, 0.f}},
-      NULL,
-      &map_draw_conf);
+  // The music keeps playing while the lake loads, so everything is read
+  // through the I/O scheduler. It can't refill the audio while the files are
+  // decompressed and set up, so that still happens between the steps.
+  load_map();
+  core_audio_pump();
 
-  shadow_model = t3d_model_load("rom:/avanto/shadow.t3dm");
+  shadow_model = t3d_model_load("load:/avanto/shadow.t3dm");
+  core_audio_pump();
+  instanced_block_init(&shadow_block, shadow_model, false, NULL, 0);
   for (size_t i = 0; i < 4; i++) {
-    entity_init(&shadows[i],
-        shadow_model,
-        &(T3DVec3) {{1.f, 1.f, 1.f}},
-        &(T3DVec3) {{0.f, 0.f, 0.f}},
-        &(T3DVec3) {{0.f, 0.f, 0.f}},
-        NULL,
-        NULL);
+    entity_init_moving(&shadows[i], &shadow_block, NULL);
   }
 
-  t3d_viewport_set_projection(&viewport, FOV, 50, 5000);
+  t3d_viewport_set_projection(&viewport, FOV, NEAR_PLANE, FAR_PLANE);
   update_cam(PLAYER_STARTING_Z);
 
   static T3DVec3 light_dir[] = {
@@ -379,6 +475,7 @@ void lake_init() {
     players[i].rotation = 0.f;
     players[i].pos =
       (T3DVec3) {{PLAYER_MIN_X+PLAYER_DISTANCE*i, 0.f, PLAYER_STARTING_Z}};
+    interp_register(players[i].pos.v, 3, INTERP_LINEAR);
     t3d_anim_attach(&players[i].s.anims[WALK], &players[i].s.skeleton);
     t3d_anim_update(&players[i].s.anims[WALK], 0);
     players[i].current_anim = WALK;
@@ -400,9 +497,10 @@ void lake_init() {
     leg_bones[i][1] = bone_index == -1?
       NULL : &players[i].s.skeleton.bones[bone_index];
 
-    particle_source_init(&steam_sources[i], NUM_STEAM_PARTICLES, STEAM);
+    particle_source_init_moving(&steam_sources[i], NUM_STEAM_PARTICLES, STEAM);
     steam_sources[i].render = !players[i].out;
     steam_sources[i].scale = (T3DVec3) {{1.f, 1.f, 1.f}};
+    steam_sources[i].particle_x_scale = .5f;
     steam_sources[i].rot = (T3DVec3) {{0.f, 0.f, 0.f}};
     steam_sources[i].x_range = 15;
     steam_sources[i].z_range = 20;
@@ -414,7 +512,8 @@ void lake_init() {
   }
 
   for (size_t i = 0; i < NUM_SPLASH_SOURCES; i++) {
-    particle_source_init(&splash_sources[i], MAX_SPLASH_PARTICLES, SPLASH);
+    particle_source_init_moving(&splash_sources[i], MAX_SPLASH_PARTICLES,
+        SPLASH);
     splash_sources[i].render = false;
     splash_sources[i].paused = true;
     splash_sources[i].speed = 64.f;
@@ -425,14 +524,16 @@ void lake_init() {
     splash_sources[i].particle_size = 4;
     splash_sources[i].scale = (T3DVec3) {{1.f, 1.f, 1.f}};
     splash_sources[i].rot = (T3DVec3) {{0.f, 0.f, 0.f}};
-    wav64_open(&sfx_splash[i], "rom:/avanto/splash.wav64");
   }
+  core_audio_pump();
 
+  atlas_load(&ui_atlas,
+      "load:/avanto/ui-atlas.sprite",
+      "load:/avanto/ui-atlas.rects");
   load_buttons();
-  penalty_sprite = sprite_load("rom:/avanto/penalty.sprite");
-  balloon_sprite = sprite_load("rom:/avanto/balloon.sprite");
-  tail_sprite = sprite_load("rom:/avanto/tail.sprite");
-  memset(&tail_params, 0, sizeof(tail_params));
+  penalty_rect = atlas_find(&ui_atlas, "penalty");
+  balloon_rect = atlas_find(&ui_atlas, "balloon");
+  tail_rect = atlas_find(&ui_atlas, "tail");
 
   winners_mask = 0;
   banner_str[0] = 0;
@@ -475,22 +576,25 @@ void lake_init() {
   lake_stage = LAKE_INTRO;
 }
 
-void lake_dynamic_loop_pre(float delta_time) {
-  joypad_buttons_t pressed[4];
-  joypad_buttons_t held[4];
-  for (size_t i = 0; i < core_get_playercount(); i++) {
-    pressed[i] = joypad_get_buttons_pressed(core_get_playercontroller(i));
-    held[i] = joypad_get_buttons_held(core_get_playercontroller(i));
+// Called when swimming starts or stops, so the draw position doesn't jump
+// between the blended and the raw one
+static void snap_draw_pos() {
+  for (size_t i = 0; i < 4; i++) {
+    interp_snap(players[i].pos.v);
   }
-  for (size_t i = core_get_playercount(); i < 4; i++) {
-    if (lake_stage == LAKE_GAME) {
-      ais[i].handler(&ais[i], &pressed[i], &held[i], delta_time);
-    }
-    else {
-      pressed[i].raw = 0;
-    }
+}
+
+static void get_draw_pos(size_t pid, T3DVec3 *pos) {
+  // Swimming happens in the fixed loop, everything else moves every frame
+  if (lake_stage == LAKE_GAME) {
+    interp_get(players[pid].pos.v, pos->v);
   }
+  else {
+    *pos = players[pid].pos;
+  }
+}
 
+void lake_dynamic_loop_pre(float delta_time) {
   // Logic handling camera movement needs to follow framerate
   if (lake_stage == LAKE_INTRO) {
     lake_intro_dynamic_loop(delta_time);
@@ -499,116 +603,61 @@ void lake_dynamic_loop_pre(float delta_time) {
     lake_outro_dynamic_loop(delta_time);
   }
 
-  if (lake_stage == LAKE_END) {
-    if (min_time_before_exiting >= EPS) {
-      min_time_before_exiting -= delta_time;
-    }
-    else {
-      for (size_t i = 0; i < core_get_playercount(); i++) {
-        size_t c = core_get_playercontroller(i);
-        if (pressed[c].a || pressed[c].b) {
-          lake_stage++;
-        }
-      }
-    }
-  }
-
   if (lake_stage != LAKE_GAME) {
     return;
   }
 
-  if (time_left > LAKE_TIME) {
-    time_left = LAKE_TIME;
-  }
-  else {
-    time_left -= delta_time;
-  }
-  if (time_left < EPS) {
-    lake_stage++;
-    return;
-  }
-
-  bool ended = false;
   int num_in = 0;
   float avg_z = 0.f;
   float max_z = -INFINITY;
-  if (splash_cooldown >= EPS) {
-    splash_cooldown -= delta_time;
-  }
   for (size_t i = 0; i < 4; i++) {
     if (players[i].out) {
       continue;
     }
+    T3DVec3 pos;
+    get_draw_pos(i, &pos);
     num_in++;
-    float bonus_mul = players[i].temperature >= EPS? HEAT_BONUS : 1.f;
-
-    if (players[i].pos.v[2] < expected_zs[i]) {
-      if (splash_cooldown < EPS && rand_float(0, 1.f) < CHANCE_TO_SPLASH) {
-        generate_splash(
-            (T3DVec3) {{players[i].pos.v[0], WATER_Y, players[i].pos.v[2]}},
-            false);
-        splash_cooldown = SPLASH_INTERVAL;
-      }
-      float nz = players[i].pos.v[2] + SWIM_SPEED*bonus_mul*delta_time;
-      if (nz > expected_zs[i]) {
-        nz = expected_zs[i];
-      }
-      players[i].pos.v[2] = nz;
-      t3d_anim_set_playing(&players[i].s.anims[players[i].current_anim], true);
-    } else {
-      t3d_anim_set_looping(&players[i].s.anims[players[i].current_anim],
-          false);
-    }
-
-    avg_z += players[i].pos.v[2];
-    max_z = players[i].pos.v[2] > max_z? players[i].pos.v[2] : max_z;
-
-    if (RACE_END_Z - players[i].pos.v[2] < EPS) {
-      ended = true;
-      players[i].pos.v[2] = RACE_END_Z;
-      winners_mask |= 1 << i;
-      core_set_winner(i);
-      continue;
-    }
-
-    if (penalties[i] >= EPS) {
-      penalties[i] -= delta_time;
-    }
-    else if (last_held_was_clean[i]) {
-      if (pressed[i].raw == next_buttons[i]->mask) {
-        expected_zs[i] += ADVANCE_PER_STROKE*bonus_mul;
-        next_buttons[i] = get_next_button(next_buttons[i]);
-      }
-      else if (pressed[i].raw && !pressed[i].start) {
-        penalties[i] = PENALTY_TIME;
-      }
-    }
-
-    if (players[i].temperature >= EPS) {
-      players[i].temperature -= delta_time / TEMP_LOSS_TIME;
-    }
-
-    last_held_was_clean[i] = !held[i].raw;
+    avg_z += pos.v[2];
+    max_z = pos.v[2] > max_z? pos.v[2] : max_z;
   }
   avg_z /= (float) num_in;
 
   float cam_z = max_z - avg_z < MAX_CAM_Z_OFFSET?
     avg_z : max_z - MAX_CAM_Z_OFFSET;
   update_cam(cam_z);
+}
 
-  if (ended) {
-    lake_stage++;
+static void update_water_offset(float delta_time) {
+  if (water_tile_size[0] < EPS) {
+    return;
   }
+
+  // Wrapped here, so it never grows large enough to lose precision
+  water_offset.offset[0] = fm_fmodf(
+      water_offset.offset[0] + WATER_S_SPEED * delta_time,
+      water_tile_size[0]);
+  water_offset.offset[1] = fm_fmodf(
+      water_offset.offset[1] + WATER_T_SPEED * delta_time,
+      water_tile_size[1]);
 }
 
-static void update_water_offset(float delta_time) {
-  T3DMaterialTexture *t = &water_object->material->textureA;
+static void draw_map(float delta_time) {
+  // Fade into the sky instead of popping at the far plane
+  rdpq_set_fog_color(SKY_COLOR);
+  rdpq_mode_fog(RDPQ_FOG_STANDARD);
+  t3d_fog_set_range(FOG_NEAR, FAR_PLANE);
+  t3d_fog_set_enabled(true);
 
-  t->s.low += WATER_S_SPEED * delta_time;
-  t->s.low = fm_fmodf(t->s.low, t->s.height);
+  update_water_offset(delta_time);
+  for (size_t i = 0; i < num_map_slabs; i++) {
+    if (t3d_frustum_vs_aabb(&viewport.viewFrustum,
+          &map_slabs[i].min, &map_slabs[i].max)) {
+      uniform_block_run(&map_slabs[i].block, &water_offset);
+    }
+  }
 
-  t->t.low += WATER_T_SPEED * delta_time;
-  t->t.low = fm_fmodf(t->t.low, t->t.height);
+  t3d_fog_set_enabled(false);
+  rdpq_mode_fog(0);
 }
 
 void lake_dynamic_loop_render(float delta_time) {
@@ -616,19 +665,12 @@ void lake_dynamic_loop_render(float delta_time) {
     return;
   }
 
-  t3d_screen_clear_color(RGBA32(0x00, 0xb5, 0xe2, 0xff));
+  t3d_screen_clear_color(SKY_COLOR);
   t3d_screen_clear_depth();
 
-  // Map
-  rspq_block_run(map.display_block);
-
-  // Water
-  update_water_offset(delta_time);
-  t3d_matrix_push(map.transform);
-  t3d_model_draw_material(water_object->material, NULL);
-  t3d_model_draw_object(water_object, NULL);
-  t3d_matrix_pop(1);
+  draw_map(delta_time);
 
+  // The matrices are all written first, since they are flushed together
   for (size_t i = 0; i < 4; i++) {
     if (!players[i].visible) {
       continue;
@@ -640,13 +682,16 @@ void lake_dynamic_loop_render(float delta_time) {
       t3d_skeleton_update(&players[i].s.skeleton);
     }
 
+    T3DVec3 pos;
+    get_draw_pos(i, &pos);
+
     T3DMat4 player_matrix;
     t3d_mat4_from_srt_euler(&player_matrix,
       (float[3]) {players[i].scale, players[i].scale, players[i].scale},
       (float[3]) {0, players[i].rotation, 0},
-      players[i].pos.v);
-    t3d_mat4_to_fixed_3x4(players[i].e.transform, &player_matrix);
-    rspq_block_run(players[i].e.display_block);
+      pos.v);
+    t3d_mat4_to_fixed_3x4(entity_get_frame_transform(&players[i].e),
+        &player_matrix);
 
     T3DVec3 tmp;
     T3DVec3 tmp2;
@@ -665,70 +710,70 @@ void lake_dynamic_loop_render(float delta_time) {
     t3d_vec3_scale(&tmp2, &tmp, .5f);
 
     T3DVec3 shadow_pos;
-    t3d_vec3_add(&shadow_pos, &players[i].pos, &tmp2);
-    shadow_pos.v[1] = get_ground_height(players[i].pos.v[2], &ground) + 4.f;
+    t3d_vec3_add(&shadow_pos, &pos, &tmp2);
+    shadow_pos.v[1] = get_ground_height(pos.v[2], &ground) + 4.f;
 
-    t3d_mat4fp_from_srt_euler(shadows[i].transform,
+    t3d_mat4fp_from_srt_euler(entity_get_frame_transform(&shadows[i]),
       (float[3]) {SHADOW_SCALE, SHADOW_SCALE, SHADOW_SCALE},
       (float[3]) {get_ground_angle(shadow_pos.v[2], &ground), 0, 0},
       shadow_pos.v);
-    rspq_block_run(shadows[i].display_block);
   }
 
-  // Particles
-  rdpq_sync_pipe();
+  for (size_t i = 0; i < NUM_SPLASH_SOURCES; i++) {
+    if (splash_sources[i].render) {
+      particle_source_update_transform(&splash_sources[i]);
+    }
+  }
 
-  rdpq_mode_push();
-  rdpq_set_mode_standard();
-  rdpq_mode_zbuf(true, true);
-  rdpq_mode_zoverride(true, 0, 0);
-  rdpq_mode_combiner(RDPQ_COMBINER_FLAT);
-  rdpq_mode_blender(RDPQ_BLENDER_MULTIPLY);
-  tpx_state_from_t3d();
+  for (size_t i = 0; i < 4; i++) {
+    if (steam_sources[i].render) {
+      get_draw_pos(i, &steam_sources[i].pos);
+      steam_sources[i].pos.v[1] += 128.f + 1.3f*64.f;
+      steam_sources[i].rot.v[1] = players[i].rotation;
+      particle_source_update_transform(&steam_sources[i]);
+    }
+  }
+  flush_frame_transforms();
 
-  tpx_state_set_scale(1.f, 1.f);
-  particle_source_draw(&snow_particle_source);
+  for (size_t i = 0; i < 4; i++) {
+    if (!players[i].visible) {
+      continue;
+    }
+    entity_draw(&players[i].e, players[i].uniforms);
+    entity_draw(&shadows[i], NULL);
+  }
+
+  // Particles
+  particle_source_queue(&snow_particle_source);
 
   for (size_t i = 0; i < NUM_SPLASH_SOURCES; i++) {
     if (!splash_sources[i].render) {
       continue;
     }
-    particle_source_draw(&splash_sources[i]);
+    particle_source_queue(&splash_sources[i]);
   }
 
-  tpx_state_set_scale(.5f, 1.f);
   for (size_t i = 0; i < 4; i++) {
     if (!steam_sources[i].render) {
       continue;
     }
 
-    steam_sources[i].pos = players[i].pos;
-    steam_sources[i].pos.v[1] += 128.f + 1.3f*64.f;
-    steam_sources[i].rot.v[1] = players[i].rotation;
-    particle_source_update_transform(&steam_sources[i]);
-    particle_source_draw(&steam_sources[i]);
+    particle_source_queue(&steam_sources[i]);
   }
-  tpx_state_set_scale(1.f, 1.f);
-
-  rdpq_sync_pipe();
-  rdpq_mode_pop();
-
-  // Sync before manual draws
-  rdpq_sync_load();
 
   if (lake_stage == LAKE_GAME) {
-    rdpq_mode_push();
-    rdpq_mode_zbuf(false, false);
+    static struct atlas_batch batch;
+    int inst_xs[4];
+    int inst_ys[4];
+    atlas_batch_begin(&batch, &ui_atlas, "lake balloons");
     for (size_t i = 0; i < 4; i++) {
       if (players[i].out) {
         continue;
       }
 
-      T3DVec3 player_head = {{
-        players[i].pos.v[0],
-        players[i].pos.v[1] + 1.8f*64.f,
-        players[i].pos.v[2],
-      }};
+      T3DVec3 player_head;
+      get_draw_pos(i, &player_head);
+      player_head.v[1] += 1.8f*64.f;
       T3DVec3 p_pos;
       t3d_viewport_calc_viewspace_pos(&viewport, &p_pos, &player_head);
       int inst_x = p_pos.v[0] < 100.f?
@@ -738,49 +783,49 @@ void lake_dynamic_loop_render(float delta_time) {
       int inst_y = INST_MAX_Y - i*INST_Y_GAP;
 
       int tail_x;
+      bool tail_flip;
       if (inst_x < (int) p_pos.v[0]) {
-        tail_params.flip_x = false;
-        tail_x = inst_x + balloon_sprite->width - 2;
+        tail_flip = false;
+        tail_x = inst_x + balloon_rect->w - 2;
       }
       else {
-        tail_x = inst_x - tail_sprite->width + 1;
-        tail_params.flip_x = true;
+        tail_x = inst_x - tail_rect->w + 1;
+        tail_flip = true;
       }
       int tail_y = (int) p_pos.v[1];
       if (tail_y < inst_y) {
         tail_y = inst_y;
       }
-      else if (tail_y >= inst_y+balloon_sprite->height-tail_sprite->height) {
-        tail_y = inst_y + balloon_sprite->height - tail_sprite->height;
+      else if (tail_y >= inst_y+balloon_rect->h-tail_rect->h) {
+        tail_y = inst_y + balloon_rect->h - tail_rect->h;
       }
 
-      rdpq_mode_push();
-      rdpq_set_mode_standard();
-      rdpq_mode_alphacompare(0xff);
-      rdpq_sprite_blit(balloon_sprite, inst_x, inst_y, NULL);
-      rdpq_sprite_blit(tail_sprite, tail_x, tail_y, &tail_params);
-      rdpq_sprite_blit(
-          next_buttons[i]->sprite,
+      atlas_batch_add(&batch, balloon_rect, inst_x, inst_y, false);
+      atlas_batch_add(&batch, tail_rect, tail_x, tail_y, tail_flip);
+      atlas_batch_add(&batch,
+          next_buttons[i]->rect,
           inst_x+16,
           inst_y+3,
-          NULL);
+          false);
       if (penalties[i] >= EPS) {
-        rdpq_sprite_blit(
-            penalty_sprite,
-            inst_x+16,
-            inst_y+3,
-            NULL);
+        atlas_batch_add(&batch, penalty_rect, inst_x+16, inst_y+3, false);
       }
-      rdpq_mode_pop();
+      inst_xs[i] = inst_x;
+      inst_ys[i] = inst_y;
+    }
+
+    atlas_batch_queue(&batch, PASS_UI);
 
-      MITIGATE_FONT_BUG;
-      rdpq_text_print(NULL,
+    for (size_t i = 0; i < 4; i++) {
+      if (players[i].out) {
+        continue;
+      }
+      textcache_queue(NULL,
           FONT_NORMAL,
-          inst_x+3,
-          inst_y+14,
+          inst_xs[i]+3,
+          inst_ys[i]+14,
           PLAYER_TITLES[i]);
     }
-    rdpq_mode_pop();
   }
 
   if (lake_stage < LAKE_OUTRO) {
@@ -788,23 +833,15 @@ void lake_dynamic_loop_render(float delta_time) {
   }
 
   if (lake_stage == LAKE_GAME) {
-    MITIGATE_FONT_BUG;
-    rdpq_text_printf(&timer_params,
-      FONT_TIMER,
-      0,
-      TIMER_Y,
-      "%.0f",
-      ceilf(time_left));
+    draw_timer(time_left);
   }
 
   if (banner_str[0]) {
-    rdpq_mode_push();
-    rdpq_mode_zbuf(false, false);
-    MITIGATE_FONT_BUG;
-    rdpq_text_print(&banner_params, FONT_BANNER, 0, 120, banner_str);
-    rdpq_mode_pop();
+    textcache_queue(&banner_params, FONT_BANNER, 0, 120, banner_str);
   }
 
+  draw_text_queue();
+
   if (fade >= EPS) {
     draw_fade(fade);
   }
@@ -932,6 +969,7 @@ static void lake_intro_dynamic_loop(float delta_time) {
   if (done) {
     wav64_play(&sfx_start, MINIGAME_CHANNEL);
     lake_stage++;
+    snap_draw_pos();
   }
 }
 
@@ -1019,7 +1057,88 @@ static void lake_outro_dynamic_loop(float delta_time) {
   }
 }
 
-void lake_end_fixed_loop(float delta_time) {
+static void lake_game_fixed_loop(float delta_time,
+    struct tick_input *input) {
+  for (size_t i = core_get_playercount(); i < 4; i++) {
+    ais[i].handler(&ais[i], &input->pressed[i], &input->held[i], delta_time);
+  }
+
+  if (time_left > LAKE_TIME) {
+    time_left = LAKE_TIME;
+  }
+  else {
+    time_left -= delta_time;
+  }
+  if (time_left < EPS) {
+    lake_stage++;
+    snap_draw_pos();
+    return;
+  }
+
+  bool ended = false;
+  if (splash_cooldown >= EPS) {
+    splash_cooldown -= delta_time;
+  }
+  for (size_t i = 0; i < 4; i++) {
+    if (players[i].out) {
+      continue;
+    }
+    float bonus_mul = players[i].temperature >= EPS? HEAT_BONUS : 1.f;
+
+    if (players[i].pos.v[2] < expected_zs[i]) {
+      if (splash_cooldown < EPS && rand_float(0, 1.f) < CHANCE_TO_SPLASH) {
+        generate_splash(
+            (T3DVec3) {{players[i].pos.v[0], WATER_Y, players[i].pos.v[2]}},
+            false);
+        splash_cooldown = SPLASH_INTERVAL;
+      }
+      float nz = players[i].pos.v[2] + SWIM_SPEED*bonus_mul*delta_time;
+      if (nz > expected_zs[i]) {
+        nz = expected_zs[i];
+      }
+      players[i].pos.v[2] = nz;
+      t3d_anim_set_playing(&players[i].s.anims[players[i].current_anim], true);
+    } else {
+      t3d_anim_set_looping(&players[i].s.anims[players[i].current_anim],
+          false);
+    }
+
+    if (RACE_END_Z - players[i].pos.v[2] < EPS) {
+      ended = true;
+      players[i].pos.v[2] = RACE_END_Z;
+      winners_mask |= 1 << i;
+      core_set_winner(i);
+      continue;
+    }
+
+    joypad_buttons_t pressed = input->pressed[i];
+    if (penalties[i] >= EPS) {
+      penalties[i] -= delta_time;
+    }
+    else if (last_held_was_clean[i]) {
+      if (pressed.raw == next_buttons[i]->mask) {
+        expected_zs[i] += ADVANCE_PER_STROKE*bonus_mul;
+        next_buttons[i] = get_next_button(next_buttons[i]);
+      }
+      else if (pressed.raw && !pressed.start) {
+        penalties[i] = PENALTY_TIME;
+      }
+    }
+
+    if (players[i].temperature >= EPS) {
+      players[i].temperature -= delta_time / TEMP_LOSS_TIME;
+    }
+
+    last_held_was_clean[i] = !input->held[i].raw;
+  }
+
+  if (ended) {
+    lake_stage++;
+    snap_draw_pos();
+  }
+}
+
+void lake_end_fixed_loop(float delta_time, struct tick_input *input) {
   static float winner_sfx_time_left;
   if (lake_stage_inited[LAKE_END]) {
     if (winner_sfx_time_left >= EPS) {
@@ -1028,6 +1147,18 @@ void lake_end_fixed_loop(float delta_time) {
         xm64player_set_vol(&music, 1.f);
       }
     }
+
+    if (min_time_before_exiting >= EPS) {
+      min_time_before_exiting -= delta_time;
+    }
+    else {
+      for (size_t i = 0; i < core_get_playercount(); i++) {
+        if (input->pressed[i].a || input->pressed[i].b) {
+          lake_stage++;
+          break;
+        }
+      }
+    }
     return;
   }
 
@@ -1072,9 +1203,16 @@ void lake_fade_out_fixed_loop(float delta_time) {
 }
 
 bool lake_fixed_loop(float delta_time) {
+  struct tick_input input;
+  input_take(&input);
+
   switch (lake_stage) {
+    case LAKE_GAME:
+      lake_game_fixed_loop(delta_time, &input);
+      break;
+
     case LAKE_END:
-      lake_end_fixed_loop(delta_time);
+      lake_end_fixed_loop(delta_time, &input);
       break;
 
     case LAKE_FADE_OUT:
@@ -1113,14 +1251,8 @@ bool lake_fixed_loop(float delta_time) {
 }
 
 void lake_cleanup() {
-  sprite_free(tail_sprite);
-  sprite_free(balloon_sprite);
-  sprite_free(penalty_sprite);
-  for (size_t i = 0; i < NUM_BUTTONS; i++) {
-    sprite_free(buttons[i].sprite);
-  }
+  atlas_free(&ui_atlas);
   for (size_t i = 0; i < NUM_SPLASH_SOURCES; i++) {
-    wav64_close(&sfx_splash[i]);
     particle_source_free(&splash_sources[i]);
   }
   particle_source_free(&snow_particle_source);
@@ -1128,7 +1260,7 @@ void lake_cleanup() {
     entity_free(&shadows[i]);
     particle_source_free(&steam_sources[i]);
   }
+  uniform_block_free(&shadow_block);
   t3d_model_free(shadow_model);
-  entity_free(&map);
-  t3d_model_free(map_model);
+  free_map();
 }
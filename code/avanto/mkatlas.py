@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""Packs several PNGs into one atlas image plus a table of their rects.
+
+Usage: mkatlas.py WIDTH OUT.png OUT.rects IN.png...
+
+Images are placed on shelves in the order given, so list them in the
+order they are layered when drawn. The rect table is big endian:
+  char magic[4] = "ATLS", uint32 count,
+  count * { char name[16], uint16 x, y, w, h }
+where name is the file name without its extensions.
+"""
+
+import os
+import struct
+import sys
+
+from PIL import Image
+
+NAME_LEN = 16
+
+
+def pack(images, width):
+    rects = []
+    x = y = shelf_height = 0
+    for name, image in images:
+        w, h = image.size
+        if w > width:
+            sys.exit(f"mkatlas: {name} is wider than the atlas ({w} > {width})")
+        if x + w > width:
+            x = 0
+            y += shelf_height
+            shelf_height = 0
+        rects.append((name, x, y, w, h))
+        x += w
+        shelf_height = max(shelf_height, h)
+    return rects, y + shelf_height
+
+
+def main():
+    if len(sys.argv) < 5:
+        sys.exit(__doc__)
+    width = int(sys.argv[1])
+    out_png, out_rects = sys.argv[2], sys.argv[3]
+
+    images = []
+    for path in sys.argv[4:]:
+        name = os.path.basename(path).split(".")[0]
+        if len(name) >= NAME_LEN:
+            sys.exit(f"mkatlas: name {name} is too long")
+        images.append((name, Image.open(path).convert("RGBA")))
+
+    rects, height = pack(images, width)
+    atlas = Image.new("RGBA", (width, height), (0, 0, 0, 0))
+    for (_, image), (_, x, y, _, _) in zip(images, rects):
+        atlas.paste(image, (x, y))
+    atlas.save(out_png)
+
+    with open(out_rects, "wb") as f:
+        f.write(struct.pack(">4sI", b"ATLS", len(rects)))
+        for name, x, y, w, h in rects:
+            f.write(struct.pack(">16s4H", name.encode(), x, y, w, h))
+
+
+if __name__ == "__main__":
+    main()
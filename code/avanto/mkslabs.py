@@ -0,0 +1,366 @@
+#!/usr/bin/env python3
+# Splits a glTF binary map into slabs along Z so each one can be culled
+# separately. Objects that fit in a single slab are only renamed, longer ones
+# are clipped at the slab boundaries. Each output node is named
+# "<name>.slab<K>" and the bounds of every slab are written as:
+#
+#   char magic[4] = "SLAB";
+#   u32 count;
+#   struct { float min[3]; float max[3]; } bounds[count];
+#
+# All big endian, positions multiplied by the model scale.
+
+import json
+import math
+import struct
+import sys
+
+GLB_MAGIC = 0x46546c67
+CHUNK_JSON = 0x4e4f534a
+CHUNK_BIN = 0x004e4942
+
+FLOAT = 5126
+UNSIGNED_SHORT = 5123
+UNSIGNED_INT = 5125
+ARRAY_BUFFER = 34962
+ELEMENT_ARRAY_BUFFER = 34963
+
+COMPONENTS = {'SCALAR': 1, 'VEC2': 2, 'VEC3': 3, 'VEC4': 4}
+
+
+def usage():
+    print('Usage: mkslabs.py <slab size> <scale> <in.glb> <out.glb> <out.slabs>',
+          file=sys.stderr)
+    sys.exit(1)
+
+
+def read_glb(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    magic, version, length = struct.unpack_from('<III', data, 0)
+    if magic != GLB_MAGIC or version != 2:
+        sys.exit(f'{path}: not a glTF 2.0 binary')
+    gltf = None
+    binary = b''
+    offset = 12
+    while offset < length:
+        size, kind = struct.unpack_from('<II', data, offset)
+        chunk = data[offset+8:offset+8+size]
+        if kind == CHUNK_JSON:
+            gltf = json.loads(chunk)
+        elif kind == CHUNK_BIN:
+            binary = bytes(chunk)
+        offset += 8 + size
+    return gltf, binary
+
+
+def write_glb(path, gltf, binary):
+    js = json.dumps(gltf, separators=(',', ':')).encode()
+    js += b' ' * (-len(js) % 4)
+    binary += b'\0' * (-len(binary) % 4)
+    length = 12 + 8 + len(js) + 8 + len(binary)
+    with open(path, 'wb') as f:
+        f.write(struct.pack('<III', GLB_MAGIC, 2, length))
+        f.write(struct.pack('<II', len(js), CHUNK_JSON))
+        f.write(js)
+        f.write(struct.pack('<II', len(binary), CHUNK_BIN))
+        f.write(binary)
+
+
+def read_accessor(gltf, binary, index):
+    acc = gltf['accessors'][index]
+    view = gltf['bufferViews'][acc['bufferView']]
+    n = COMPONENTS[acc['type']]
+    fmt = {FLOAT: 'f', UNSIGNED_SHORT: 'H', UNSIGNED_INT: 'I'}[acc['componentType']]
+    size = struct.calcsize(fmt)
+    stride = view.get('byteStride', n * size)
+    base = view.get('byteOffset', 0) + acc.get('byteOffset', 0)
+    out = []
+    for i in range(acc['count']):
+        v = struct.unpack_from(f'<{n}{fmt}', binary, base + i * stride)
+        out.append(v if n > 1 else v[0])
+    return out
+
+
+def mat_mul(a, b):
+    return [[sum(a[i][k] * b[k][j] for k in range(4)) for j in range(4)]
+            for i in range(4)]
+
+
+def node_matrix(node):
+    if 'matrix' in node:
+        m = node['matrix']
+        return [[m[c * 4 + r] for c in range(4)] for r in range(4)]
+    tx, ty, tz = node.get('translation', [0, 0, 0])
+    x, y, z, w = node.get('rotation', [0, 0, 0, 1])
+    sx, sy, sz = node.get('scale', [1, 1, 1])
+    r = [
+        [1 - 2*(y*y + z*z), 2*(x*y - z*w), 2*(x*z + y*w)],
+        [2*(x*y + z*w), 1 - 2*(x*x + z*z), 2*(y*z - x*w)],
+        [2*(x*z - y*w), 2*(y*z + x*w), 1 - 2*(x*x + y*y)],
+    ]
+    return [
+        [r[0][0]*sx, r[0][1]*sy, r[0][2]*sz, tx],
+        [r[1][0]*sx, r[1][1]*sy, r[1][2]*sz, ty],
+        [r[2][0]*sx, r[2][1]*sy, r[2][2]*sz, tz],
+        [0, 0, 0, 1],
+    ]
+
+
+def transform(m, p):
+    return tuple(m[i][0]*p[0] + m[i][1]*p[1] + m[i][2]*p[2] + m[i][3]
+                 for i in range(3))
+
+
+def lerp(a, b, t):
+    if a is None:
+        return None
+    return tuple(x + (y - x) * t for x, y in zip(a, b))
+
+
+class Vertex:
+    def __init__(self, world, pos, attrs):
+        self.world = world
+        self.pos = pos
+        self.attrs = attrs
+
+    def towards(self, other, t):
+        return Vertex(lerp(self.world, other.world, t),
+                      lerp(self.pos, other.pos, t),
+                      {k: lerp(v, other.attrs[k], t)
+                       for k, v in self.attrs.items()})
+
+
+def clip(poly, z, keep_above):
+    out = []
+    for i, a in enumerate(poly):
+        b = poly[(i + 1) % len(poly)]
+        a_in = (a.world[2] >= z) if keep_above else (a.world[2] <= z)
+        b_in = (b.world[2] >= z) if keep_above else (b.world[2] <= z)
+        if a_in:
+            out.append(a)
+        if a_in != b_in:
+            t = (z - a.world[2]) / (b.world[2] - a.world[2])
+            out.append(a.towards(b, t))
+    return out
+
+
+class Writer:
+    def __init__(self, gltf, binary):
+        self.gltf = gltf
+        self.binary = bytearray(binary)
+
+    def add(self, values, kind, component, target):
+        self.binary += b'\0' * (-len(self.binary) % 4)
+        fmt = {FLOAT: 'f', UNSIGNED_SHORT: 'H', UNSIGNED_INT: 'I'}[component]
+        start = len(self.binary)
+        for v in values:
+            v = v if isinstance(v, tuple) else (v,)
+            self.binary += struct.pack(f'<{len(v)}{fmt}', *v)
+        self.gltf['bufferViews'].append({
+            'buffer': 0,
+            'byteOffset': start,
+            'byteLength': len(self.binary) - start,
+            'target': target,
+        })
+        acc = {
+            'bufferView': len(self.gltf['bufferViews']) - 1,
+            'componentType': component,
+            'count': len(values),
+            'type': kind,
+        }
+        if kind == 'VEC3' and component == FLOAT:
+            acc['min'] = [min(v[i] for v in values) for i in range(3)]
+            acc['max'] = [max(v[i] for v in values) for i in range(3)]
+        self.gltf['accessors'].append(acc)
+        return len(self.gltf['accessors']) - 1
+
+
+def load_primitive(gltf, binary, prim, matrix):
+    if prim.get('mode', 4) != 4:
+        sys.exit('mkslabs: only triangle lists are supported')
+    names = [k for k in prim['attributes'] if k != 'POSITION']
+    pos = read_accessor(gltf, binary, prim['attributes']['POSITION'])
+    attrs = {k: read_accessor(gltf, binary, prim['attributes'][k]) for k in names}
+    verts = [Vertex(transform(matrix, p), p, {k: attrs[k][i] for k in names})
+             for i, p in enumerate(pos)]
+    if 'indices' in prim:
+        idx = read_accessor(gltf, binary, prim['indices'])
+    else:
+        idx = list(range(len(verts)))
+    return verts, [tuple(idx[i:i+3]) for i in range(0, len(idx), 3)]
+
+
+def emit_primitive(writer, prim, tris):
+    flat = []
+    seen = {}
+    indices = []
+    for tri in tris:
+        for v in tri:
+            if id(v) not in seen:
+                seen[id(v)] = len(flat)
+                flat.append(v)
+            indices.append(seen[id(v)])
+    out = {k: v for k, v in prim.items() if k not in ('attributes', 'indices')}
+    out['attributes'] = {'POSITION': writer.add([v.pos for v in flat], 'VEC3',
+                                                FLOAT, ARRAY_BUFFER)}
+    for k, acc in prim['attributes'].items():
+        if k == 'POSITION':
+            continue
+        values = [v.attrs[k] for v in flat]
+        if k == 'NORMAL':
+            values = [tuple(c / (math.sqrt(sum(x*x for x in n)) or 1) for c in n)
+                      for n in values]
+        out['attributes'][k] = writer.add(values,
+                                          writer.gltf['accessors'][acc]['type'],
+                                          FLOAT, ARRAY_BUFFER)
+    component = UNSIGNED_SHORT if len(flat) < 0x10000 else UNSIGNED_INT
+    out['indices'] = writer.add(indices, 'SCALAR', component,
+                                ELEMENT_ARRAY_BUFFER)
+    return out
+
+
+def main():
+    if len(sys.argv) != 6:
+        usage()
+    slab_size = float(sys.argv[1])
+    scale = float(sys.argv[2])
+    gltf, binary = read_glb(sys.argv[3])
+    writer = Writer(gltf, binary)
+
+    # World matrices of every node reachable from the scene
+    scene = gltf['scenes'][gltf.get('scene', 0)]
+    matrices = {}
+    identity = [[float(i == j) for j in range(4)] for i in range(4)]
+    stack = [(n, identity) for n in scene['nodes']]
+    while stack:
+        n, parent = stack.pop()
+        matrices[n] = mat_mul(parent, node_matrix(gltf['nodes'][n]))
+        stack += [(c, matrices[n]) for c in gltf['nodes'][n].get('children', [])]
+
+    meshes = {}
+    for n, m in matrices.items():
+        node = gltf['nodes'][n]
+        if 'mesh' not in node:
+            continue
+        if node.get('children'):
+            sys.exit(f'mkslabs: {node.get("name")} has children, flatten it first')
+        prims = [load_primitive(gltf, binary, p, m)
+                 for p in gltf['meshes'][node['mesh']]['primitives']]
+        meshes[n] = prims
+    if not meshes:
+        sys.exit('mkslabs: no meshes')
+
+    z_min = min(v.world[2] for prims in meshes.values()
+                for verts, _ in prims for v in verts)
+
+    def slab_of(z):
+        return int(math.floor((z - z_min) / slab_size))
+
+    # slab -> list of (node index, primitive list or None if unchanged)
+    slabs = {}
+    bounds = {}
+
+    def grow(k, verts):
+        lo, hi = bounds.setdefault(k, ([math.inf] * 3, [-math.inf] * 3))
+        for v in verts:
+            for i in range(3):
+                lo[i] = min(lo[i], v.world[i])
+                hi[i] = max(hi[i], v.world[i])
+
+    for n, prims in meshes.items():
+        zs = [v.world[2] for verts, _ in prims for v in verts]
+        first, last = slab_of(min(zs)), slab_of(max(zs))
+        if max(zs) - min(zs) <= slab_size:
+            # Small props are not worth cutting, they stretch the bounds
+            first = slab_of((min(zs) + max(zs)) / 2)
+            slabs.setdefault(first, []).append((n, None))
+            for verts, tris in prims:
+                grow(first, [verts[i] for t in tris for i in t])
+            continue
+
+        for k in range(first, last + 1):
+            lo = z_min + k * slab_size
+            hi = lo + slab_size
+            out = []
+            for p, (verts, tris) in zip(gltf['meshes'][gltf['nodes'][n]['mesh']]['primitives'], prims):
+                clipped = []
+                for t in tris:
+                    poly = [verts[i] for i in t]
+                    tz = [v.world[2] for v in poly]
+                    if max(tz) < lo or min(tz) >= hi:
+                        continue
+                    if min(tz) < lo:
+                        poly = clip(poly, lo, True)
+                    if max(tz) > hi:
+                        poly = clip(poly, hi, False)
+                    if len(poly) < 3:
+                        continue
+                    for i in range(1, len(poly) - 1):
+                        clipped.append((poly[0], poly[i], poly[i+1]))
+                if clipped:
+                    grow(k, [v for t in clipped for v in t])
+                    out.append(emit_primitive(writer, p, clipped))
+            if out:
+                slabs.setdefault(k, []).append((n, out))
+
+    # Renumber so only non-empty slabs are kept, in Z order
+    order = sorted(slabs)
+    new_nodes = []
+    for new_k, k in enumerate(order):
+        for n, prims in slabs[k]:
+            node = dict(gltf['nodes'][n])
+            node['name'] = f'{node.get("name", "node")}.slab{new_k}'
+            if prims is not None:
+                gltf['meshes'].append({
+                    'name': f'{gltf["meshes"][node["mesh"]].get("name", "mesh")}.slab{new_k}',
+                    'primitives': prims,
+                })
+                node['mesh'] = len(gltf['meshes']) - 1
+            new_nodes.append((node, n))
+
+    # Rebuild the node and mesh lists so the original, unsplit objects are
+    # gone even for importers that walk every node instead of the scene
+    replaced = {}
+    nodes = []
+    remap = {}
+    for n, node in enumerate(gltf['nodes']):
+        if n not in meshes:
+            remap[n] = len(nodes)
+            nodes.append(node)
+    for node, n in new_nodes:
+        replaced.setdefault(n, []).append(len(nodes))
+        nodes.append(node)
+
+    def children(old):
+        out = []
+        for c in old:
+            out += replaced.get(c, [remap[c]] if c in remap else [])
+        return out
+
+    for node in nodes:
+        if 'children' in node:
+            node['children'] = children(node['children'])
+    for s in gltf['scenes']:
+        s['nodes'] = children(s['nodes'])
+
+    used = sorted({node['mesh'] for node in nodes if 'mesh' in node})
+    mesh_remap = {m: i for i, m in enumerate(used)}
+    gltf['meshes'] = [gltf['meshes'][m] for m in used]
+    for node in nodes:
+        if 'mesh' in node:
+            node['mesh'] = mesh_remap[node['mesh']]
+    gltf['nodes'] = nodes
+    gltf['buffers'][0]['byteLength'] = len(writer.binary)
+    write_glb(sys.argv[4], gltf, writer.binary)
+
+    with open(sys.argv[5], 'wb') as f:
+        f.write(b'SLAB')
+        f.write(struct.pack('>I', len(order)))
+        for k in order:
+            lo, hi = bounds[k]
+            f.write(struct.pack('>6f', *[c * scale for c in lo + hi]))
+
+
+if __name__ == '__main__':
+    main()
@@ -1,6 +1,10 @@
 #include <libdragon.h>
 #include "../../minigame.h"
 #include "../../core.h"
+#include "../../textcache.h"
+#include "../../sfxbank.h"
+#include "../../synth.h"
+#include "../../renderstats.h"
 #include <t3d/t3d.h>
 #include <t3d/t3dmodel.h>
 #include <t3d/t3dskeleton.h>
@@ -17,9 +21,6 @@
 #define LOYLY_SCREEN_MIN_ALPHA 16.f
 #define SAUNA_LEN 60.f
 #define BASE_HEAT (.2f / 60.f)
-#define LOYLY_CHANNEL 10
-#define DOOR_CHANNEL 11
-#define MINIGAME_CHANNEL 31
 #define SCALE 2.5f
 #define SAUNA_GRAVITY (GRAVITY*SCALE)
 #define SAUNA_WALK_SPEED 100.f
@@ -54,7 +55,6 @@ extern T3DViewport viewport;
 extern struct camera cam;
 extern xm64player_t music;
 extern struct rdpq_textparms_s banner_params;
-extern struct rdpq_textparms_s timer_params;
 extern wav64_t sfx_countdown;
 extern wav64_t sfx_start;
 extern wav64_t sfx_stop;
@@ -66,8 +66,20 @@ static struct character ukko;
 static bool loyly_sound_queued;
 static bool loyly_queued;
 static float loyly_strength;
-static wav64_t sfx_loyly;
-static wav64_t sfx_door;
+static const SynthPatch sfx_loyly = {
+  .length = 3.5f,
+  .attack = .08f,
+  .decay = 1.1f,
+  .noise = .3f,
+  .lowpass = 9000.f,
+  .highpass = 2200.f,
+  .variation = .15f,
+  .resonators = {
+    {.frequency = 4200.f, .bandwidth = 2500.f, .gain = .5f, .sweep = .8f},
+    {.frequency = 7000.f, .bandwidth = 3000.f, .gain = .3f, .sweep = 1.f},
+  },
+};
+static SfxSample sfx_door;
 static int sauna_stage;
 static bool sauna_stage_inited[NUM_SAUNA_STAGES];
 static float upness[4];
@@ -79,9 +91,7 @@ static float time_left;
 static float min_time_before_exiting;
 static struct sauna_ai ais[4];
 
-static T3DModel *cube_model;
-static struct entity invisicubes[2];
-static sprite_t *kiuas;
+static surface_t sauna_depth;
 
 static bool end_when_over;
 static float fade;
@@ -151,6 +161,60 @@ static struct scene sauna_scene = {
 };
 
 
+// The depth behind the static BG never changes, so render it once and copy
+// it into the z-buffer every frame instead
+static void bake_sauna_depth() {
+  T3DModel *cube_model = t3d_model_load("rom:/avanto/unit-cube.t3dm");
+  struct entity invisicubes[2];
+  entity_init(&invisicubes[0],
+      cube_model,
+      &(T3DVec3) {{4.f*2.f, .55f*2.f, .6f*2.f}},
+      &(T3DVec3) {{0.f, 0.f, 0.f}},
+      &(T3DVec3) {{-40.f, 41.f, 330.f}},
+      NULL,
+      NULL,
+      NULL,
+      0);
+  entity_init(&invisicubes[1],
+      cube_model,
+      &(T3DVec3) {{.6f*2.f, .55f*2, 4.f*2.f}},
+      &(T3DVec3) {{0.f, 0.f, 0.f}},
+      &(T3DVec3) {{400.f, 41.f, 260.f}},
+      NULL,
+      NULL,
+      NULL,
+      0);
+  sprite_t *kiuas = sprite_load("rom:/avanto/kiuas.sprite");
+
+  sauna_depth = surface_alloc(FMT_RGBA16, 320, 240);
+  surface_t scratch = surface_alloc(FMT_RGBA16, 320, 240);
+  rdpq_attach(&scratch, &sauna_depth);
+  t3d_frame_start();
+  t3d_viewport_attach(&viewport);
+  t3d_screen_clear_depth();
+
+  // Cubes, rendered behind the BG to set the depth
+  entity_draw(&invisicubes[0], NULL);
+  entity_draw(&invisicubes[1], NULL);
+
+  // Kiuas mask, also only sets the depth
+  rstat_sync_pipe("sauna kiuas");
+  rstat_mode_push("sauna kiuas");
+  rstat_set_mode_standard("sauna kiuas");
+  rdpq_mode_zbuf(false, true);
+  rdpq_mode_zoverride(true, 0.f, 0);
+  rdpq_mode_alphacompare(1);
+  rstat_sprite_blit("sauna kiuas", kiuas, 0, 240-kiuas->height, NULL);
+  rdpq_mode_pop();
+  rdpq_detach_wait();
+
+  surface_free(&scratch);
+  sprite_free(kiuas);
+  entity_free(&invisicubes[0]);
+  entity_free(&invisicubes[1]);
+  t3d_model_free(cube_model);
+}
+
 void sauna_init() {
   ukko_model = t3d_model_load("rom:/avanto/ukko.t3dm");
   ukko.rotation = T3D_DEG_TO_RAD(90.f);
@@ -164,7 +228,9 @@ void sauna_init() {
       &(T3DVec3) {{0.f, ukko.rotation, 0.f}},
       &ukko.pos,
       &ukko.s.skeleton,
-      NULL);
+      NULL,
+      NULL,
+      0);
   t3d_anim_attach(&ukko.s.anims[THROW], &ukko.s.skeleton);
   t3d_anim_update(&ukko.s.anims[THROW], 0);
   ukko.current_anim = THROW;
@@ -177,22 +243,6 @@ void sauna_init() {
   loyly_strength = 0.f;
   banner_time = 0.f;
 
-  cube_model = t3d_model_load("rom:/avanto/unit-cube.t3dm");
-  entity_init(&invisicubes[0],
-      cube_model,
-      &(T3DVec3) {{4.f*2.f, .55f*2.f, .6f*2.f}},
-      &(T3DVec3) {{0.f, 0.f, 0.f}},
-      &(T3DVec3) {{-40.f, 41.f, 330.f}},
-      NULL,
-      NULL);
-  entity_init(&invisicubes[1],
-      cube_model,
-      &(T3DVec3) {{.6f*2.f, .55f*2, 4.f*2.f}},
-      &(T3DVec3) {{0.f, 0.f, 0.f}},
-      &(T3DVec3) {{400.f, 41.f, 260.f}},
-      NULL,
-      NULL);
-  kiuas = sprite_load("rom:/avanto/kiuas.sprite");
 
   sauna_scene.bg = sprite_load(sauna_scene.bg_path);
   const struct camera *cam = &sauna_scene.starting_cam;
@@ -201,9 +251,9 @@ void sauna_init() {
       &cam->pos,
       &cam->target,
       &(T3DVec3) {{0, 1, 0}});
+  bake_sauna_depth();
 
-  wav64_open(&sfx_loyly, "rom:/avanto/loyly.wav64");
-  wav64_open(&sfx_door, "rom:/avanto/door.wav64");
+  sfxbank_load(&sfx_door, "rom:/avanto/door.wav64");
 
   particle_source_init(&kiuas_particle_source, KIUAS_MAX_PARTICLES, STEAM);
   kiuas_particle_source.pos = (T3DVec3) {{100.f, 100.f+128.f, 0.f}};
@@ -274,7 +324,7 @@ static void sauna_intro_fixed_loop(float delta_time) {
 
 struct script_action walk_in_actions[][14] = {
   {
-    {.type = ACTION_PLAY_SFX, .sfx = &sfx_door, .channel = DOOR_CHANNEL},
+    {.type = ACTION_PLAY_SFX, .sfx = &sfx_door, .priority = SFX_PRIORITY_ACTION},
     {.type = ACTION_WAIT, .time = 2.f},
     {.type = ACTION_START_XM64, .xm64 = &music, .first_channel = 0},
     {.type = ACTION_WARP_TO, .pos = (T3DVec3) {{-100, 0, 110}}},
@@ -657,7 +707,104 @@ static void sauna_unbend_fixed_loop(float delta_time) {
   }
 }
 
+static void sauna_loyly_fixed_loop(float delta_time) {
+  if (loyly_strength >= EPS) {
+    loyly_strength -= delta_time/LOYLY_LENGTH;
+    if (loyly_strength < EPS) {
+      loyly_strength = 0.f;
+      kiuas_particle_source.render = false;
+      kiuas_particle_source.paused = true;
+    }
+  }
+  if (loyly_sound_queued
+      && ukko.s.anims[THROW].time + delta_time >= LOYLY_SOUND_DELAY) {
+    synth_play(&sfx_loyly, SFX_PRIORITY_ACTION, .5f);
+    loyly_sound_queued = false;
+  }
+  if (loyly_queued && ukko.s.anims[THROW].time + delta_time >= LOYLY_DELAY) {
+    loyly_strength = 1.f;
+    kiuas_particle_source.render = true;
+    kiuas_particle_source.paused = false;
+    particle_source_reset_steam(&kiuas_particle_source);
+    loyly_queued = false;
+  }
+  int max_particles = (int) ((float) KIUAS_MAX_PARTICLES * loyly_strength);
+  max_particles = max_particles < 0? 0 : max_particles;
+  max_particles = max_particles > KIUAS_MAX_PARTICLES?
+    KIUAS_MAX_PARTICLES : max_particles;
+  kiuas_particle_source.max_particles = max_particles;
+  if (kiuas_particle_source.max_particles > KIUAS_MAX_PARTICLES) {
+    kiuas_particle_source.max_particles = KIUAS_MAX_PARTICLES;
+  }
+  kiuas_particle_source.time_to_rise = 2.f-loyly_strength;
+}
+
+static bool sauna_anim_ticked(size_t i) {
+  return (sauna_stage == SAUNA_GAME || sauna_stage == SAUNA_UNBEND)
+    && sauna_stage_inited[SAUNA_GAME]
+    && !players[i].out;
+}
+
+static void sauna_players_fixed_loop(float delta_time,
+    struct tick_input *input) {
+  joypad_buttons_t *held = input->held;
+  joypad_buttons_t *pressed = input->pressed;
+  for (size_t i = core_get_playercount(); i < 4; i++) {
+    if (sauna_stage == SAUNA_GAME) {
+      ais[i].handler(&ais[i], &held[i]);
+    }
+  }
+
+  if (sauna_stage == SAUNA_DONE) {
+    if (min_time_before_exiting >= EPS) {
+      min_time_before_exiting -= delta_time;
+    }
+    else {
+      for (size_t i = 0; i < 4; i++) {
+        if (pressed[i].a || pressed[i].b) {
+          sauna_stage++;
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < 4; i++) {
+    if (!sauna_anim_ticked(i)) {
+      continue;
+    }
+    if (sauna_stage == SAUNA_UNBEND) {
+      held[i].raw = 0;
+    }
+
+    // If the player is not out, animation will always be BEND or UNBEND.
+    // It is advanced here, as how far up the player is decides the score.
+    T3DAnim *anim = &players[i].s.anims[players[i].current_anim];
+    t3d_anim_update(anim, delta_time);
+    if (players[i].current_anim == BEND) {
+      upness[i] = anim->isPlaying?
+        1.f - anim->time/anim->animRef->duration : 0.f;
+    }
+    else {
+      upness[i] = anim->isPlaying? anim->time/anim->animRef->duration : 1.f;
+    }
+    
+    if (held[i].z && players[i].current_anim != BEND) {
+      sauna_change_anim_and_play_from(&players[i],
+          BEND,
+          1.f - sauna_get_anim_normal_time(&players[i].s.anims[UNBEND]));
+    }
+    else if (!held[i].z && players[i].current_anim != UNBEND) {
+      sauna_change_anim_and_play_from(&players[i],
+          UNBEND,
+          1.f - sauna_get_anim_normal_time(&players[i].s.anims[BEND]));
+    }
+  }
+}
+
 bool sauna_fixed_loop(float delta_time) {
+  struct tick_input input;
+  input_take(&input);
+
   switch (sauna_stage) {
     case SAUNA_INTRO:
       sauna_intro_fixed_loop(delta_time);
@@ -694,6 +841,9 @@ bool sauna_fixed_loop(float delta_time) {
       break;
   }
 
+  sauna_loyly_fixed_loop(delta_time);
+  sauna_players_fixed_loop(delta_time, &input);
+
   for (size_t i = 0; i < 4; i++) {
     if (players[i].current_anim != CLIMB) {
       float expected_height = get_ground_height(players[i].pos.v[2],
@@ -710,36 +860,6 @@ bool sauna_fixed_loop(float delta_time) {
 }
 
 void sauna_dynamic_loop_pre(float delta_time) {
-  if (loyly_strength >= EPS) {
-    loyly_strength -= delta_time/LOYLY_LENGTH;
-    if (loyly_strength < EPS) {
-      loyly_strength = 0.f;
-      kiuas_particle_source.render = false;
-      kiuas_particle_source.paused = true;
-    }
-  }
-  if (loyly_sound_queued
-      && ukko.s.anims[THROW].time + delta_time >= LOYLY_SOUND_DELAY) {
-    wav64_play(&sfx_loyly, LOYLY_CHANNEL);
-    loyly_sound_queued = false;
-  }
-  if (loyly_queued && ukko.s.anims[THROW].time + delta_time >= LOYLY_DELAY) {
-    loyly_strength = 1.f;
-    kiuas_particle_source.render = true;
-    kiuas_particle_source.paused = false;
-    particle_source_reset_steam(&kiuas_particle_source);
-    loyly_queued = false;
-  }
-  int max_particles = (int) ((float) KIUAS_MAX_PARTICLES * loyly_strength);
-  max_particles = max_particles < 0? 0 : max_particles;
-  max_particles = max_particles > KIUAS_MAX_PARTICLES?
-    KIUAS_MAX_PARTICLES : max_particles;
-  kiuas_particle_source.max_particles = max_particles;
-  if (kiuas_particle_source.max_particles > KIUAS_MAX_PARTICLES) {
-    kiuas_particle_source.max_particles = KIUAS_MAX_PARTICLES;
-  }
-  kiuas_particle_source.time_to_rise = 2.f-loyly_strength;
-
   for (size_t i = 0; i < 4; i++) {
     if (!players[i].out) {
       continue;
@@ -758,26 +878,30 @@ void sauna_dynamic_loop_pre(float delta_time) {
 }
 
 void sauna_dynamic_loop_render(float delta_time) {
-  t3d_screen_clear_depth();
-
-  // Cubes, rendered behind the BG to set the depth
-  rspq_block_run(invisicubes[0].display_block);
-  rspq_block_run(invisicubes[1].display_block);
-
-  // Kiuas mask, also only sets the depth
-  rdpq_sync_pipe();
-  rdpq_mode_push();
-  rdpq_set_mode_standard();
-  rdpq_mode_zbuf(false, true);
-  rdpq_mode_zoverride(true, 0.f, 0);
-  rdpq_mode_alphacompare(1);
-  rdpq_sprite_blit(kiuas, 0, 240-kiuas->height, NULL);
+  // Baked depth, drawn as a color image into the z-buffer
+  const surface_t *display_surface = rdpq_get_attached();
+  rdpq_set_color_image(z_buffer);
+  rstat_mode_push("sauna depth");
+  rstat_set_mode_copy("sauna depth", false);
+  rstat_tex_blit("sauna depth", &sauna_depth, 0, 0, NULL);
   rdpq_mode_pop();
+  rdpq_set_color_image(display_surface);
 
-  // BG
-  rdpq_mode_push();
-  rdpq_set_mode_copy(false);
-  rdpq_sprite_blit(sauna_scene.bg, 0, 0, NULL);
+  // BG, tinted by the löyly steam through the combiner when needed
+  rstat_mode_push("sauna bg");
+  if (loyly_strength >= EPS) {
+    int screen_alpha =
+      (int) ((LOYLY_SCREEN_MAX_ALPHA-LOYLY_SCREEN_MIN_ALPHA)*loyly_strength)
+      + (int) LOYLY_SCREEN_MIN_ALPHA;
+    rstat_set_mode_standard("sauna bg");
+    rdpq_set_prim_color(RGBA32(0xff, 0xff, 0xff, screen_alpha));
+    rdpq_mode_combiner(RDPQ_COMBINER1((PRIM, TEX0, PRIM_ALPHA, TEX0),
+          (0, 0, 0, 1)));
+  }
+  else {
+    rstat_set_mode_copy("sauna bg", false);
+  }
+  rstat_sprite_blit("sauna bg", sauna_scene.bg, 0, 0, NULL);
   rdpq_mode_pop();
 
   sauna_scene.do_light();
@@ -785,16 +909,23 @@ void sauna_dynamic_loop_render(float delta_time) {
   // Players
   for (size_t i = 0; i < 4; i++) {
     if (players[i].current_anim != -1) {
-      t3d_anim_update(&players[i].s.anims[players[i].current_anim],
-          delta_time);
+      if (!sauna_anim_ticked(i)) {
+        t3d_anim_update(&players[i].s.anims[players[i].current_anim],
+            delta_time);
+      }
       t3d_skeleton_update(&players[i].s.skeleton);
     }
     if (players[i].visible) {
-      t3d_mat4fp_from_srt_euler(players[i].e.transform,
+      t3d_mat4fp_from_srt_euler(entity_get_frame_transform(&players[i].e),
         (float[3]) {players[i].scale, players[i].scale, players[i].scale},
         (float[3]) {0, players[i].rotation, 0},
         players[i].pos.v);
-      rspq_block_run(players[i].e.display_block);
+    }
+  }
+  flush_frame_transforms();
+  for (size_t i = 0; i < 4; i++) {
+    if (players[i].visible) {
+      entity_draw(&players[i].e, players[i].uniforms);
     }
   }
 
@@ -802,46 +933,14 @@ void sauna_dynamic_loop_render(float delta_time) {
   t3d_anim_update(&ukko.s.anims[ukko.current_anim], delta_time);
   t3d_skeleton_update(&ukko.s.skeleton);
   if (ukko.visible) {
-    rspq_block_run(ukko.e.display_block);
+    entity_draw(&ukko.e, NULL);
   }
 
   // Particles
   if (kiuas_particle_source.render) {
-    rdpq_sync_pipe();
-
-    rdpq_mode_push();
-    rdpq_set_mode_standard();
-    rdpq_mode_zbuf(true, true);
-    rdpq_mode_zoverride(true, 0, 0);
-    rdpq_mode_combiner(RDPQ_COMBINER_FLAT);
-    rdpq_mode_blender(RDPQ_BLENDER_MULTIPLY);
-    tpx_state_from_t3d();
-
-    tpx_state_set_scale(1.f, 1.f);
-    particle_source_draw(&kiuas_particle_source);
-
-    rdpq_sync_pipe();
-
-    rdpq_mode_pop();
+    particle_source_queue(&kiuas_particle_source);
   }
 
-  rdpq_sync_pipe();
-
-  if (loyly_strength >= EPS) {
-    rdpq_mode_push();
-    int screen_alpha =
-      (int) ((LOYLY_SCREEN_MAX_ALPHA-LOYLY_SCREEN_MIN_ALPHA)*loyly_strength)
-      + (int) LOYLY_SCREEN_MIN_ALPHA;
-    rdpq_set_fog_color(RGBA32(0xff, 0xff, 0xff, screen_alpha));
-    rdpq_set_prim_color(RGBA32(0xff, 0xff, 0xff, 0xff));
-    rdpq_mode_combiner(RDPQ_COMBINER_FLAT);
-    rdpq_mode_blender(RDPQ_BLENDER_MULTIPLY_CONST);
-    rdpq_mode_zbuf(false, false);
-    rdpq_fill_rectangle(0, 0, 320, 240);
-    rdpq_mode_pop();
-  }
-
-
   // HUD
   if (sauna_stage >= SAUNA_COUNTDOWN) {
     draw_hud();
@@ -849,93 +948,22 @@ void sauna_dynamic_loop_render(float delta_time) {
 
   // Time
   if (sauna_stage == SAUNA_GAME) {
-    MITIGATE_FONT_BUG;
-    rdpq_text_printf(&timer_params,
-      FONT_TIMER,
-      0,
-      TIMER_Y,
-      "%.0f",
-      ceilf(time_left));
+    draw_timer(time_left);
   }
 
   // Banner
   if (banner_time > EPS) {
     banner_time -= delta_time;
-    MITIGATE_FONT_BUG;
-    rdpq_text_print(&banner_params, FONT_BANNER, 0, 120, banner_str);
+    textcache_queue(&banner_params, FONT_BANNER, 0, 120, banner_str);
   }
 
+  draw_text_queue();
+
   if (fade >= EPS) {
     draw_fade(fade);
   }
 }
 
-void sauna_dynamic_loop_post(float delta_time) {
-  joypad_buttons_t held[4];
-  joypad_buttons_t pressed[4];
-  for (size_t i = 0; i < core_get_playercount(); i++) {
-    held[i] = joypad_get_buttons_held(core_get_playercontroller(i));
-    pressed[i] = joypad_get_buttons_pressed(core_get_playercontroller(i));
-  }
-  for (size_t i = core_get_playercount(); i < 4; i++) {
-    pressed[i].raw = 0;
-    if (sauna_stage == SAUNA_GAME) {
-      ais[i].handler(&ais[i], &held[i]);
-    }
-    else {
-      held[i].raw = 0;
-    }
-  }
-
-  if (sauna_stage == SAUNA_DONE) {
-    if (min_time_before_exiting >= EPS) {
-      min_time_before_exiting -= delta_time;
-    }
-    else {
-      for (size_t i = 0; i < 4; i++) {
-        if (pressed[i].a || pressed[i].b) {
-          sauna_stage++;
-        }
-      }
-    }
-  }
-
-  if ((sauna_stage != SAUNA_GAME && sauna_stage != SAUNA_UNBEND)
-      || !sauna_stage_inited[SAUNA_GAME]) {
-    return;
-  }
-
-  for (size_t i = 0; i < 4; i++) {
-    if (players[i].out) {
-      continue;
-    }
-    if (sauna_stage == SAUNA_UNBEND) {
-      held[i].raw = 0;
-    }
-
-    // If the player is not out, animation will always be BEND or UNBEND
-    const T3DAnim *anim = &players[i].s.anims[players[i].current_anim];
-    if (players[i].current_anim == BEND) {
-      upness[i] = anim->isPlaying?
-        1.f - anim->time/anim->animRef->duration : 0.f;
-    }
-    else {
-      upness[i] = anim->isPlaying? anim->time/anim->animRef->duration : 1.f;
-    }
-    
-    if (held[i].z && players[i].current_anim != BEND) {
-      sauna_change_anim_and_play_from(&players[i],
-          BEND,
-          1.f - sauna_get_anim_normal_time(&players[i].s.anims[UNBEND]));
-    }
-    else if (!held[i].z && players[i].current_anim != UNBEND) {
-      sauna_change_anim_and_play_from(&players[i],
-          UNBEND,
-          1.f - sauna_get_anim_normal_time(&players[i].s.anims[BEND]));
-    }
-  }
-}
-
 void sauna_cleanup() {
   rspq_wait();
 
@@ -943,13 +971,9 @@ void sauna_cleanup() {
 
   sprite_free(sauna_scene.bg);
 
-  wav64_close(&sfx_loyly);
-  wav64_close(&sfx_door);
+  sfxbank_free(&sfx_door);
 
-  sprite_free(kiuas);
-  entity_free(&invisicubes[0]);
-  entity_free(&invisicubes[1]);
-  t3d_model_free(cube_model);
+  surface_free(&sauna_depth);
 
   entity_free(&ukko.e);
   skeleton_free(&ukko.s);
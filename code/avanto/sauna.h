@@ -1,6 +1,5 @@
 void sauna_init();
 void sauna_dynamic_loop_pre(float delta_time);
 void sauna_dynamic_loop_render(float delta_time);
-void sauna_dynamic_loop_post(float delta_time);
 bool sauna_fixed_loop(float delta_time);
 void sauna_cleanup();
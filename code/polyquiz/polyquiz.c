@@ -1,13 +1,19 @@
 #include <libdragon.h>
 #include "../../minigame.h"
 #include "../../core.h"
+#include "../../assetcache.h"
+#include "../../textcache.h"
 #include <GL/gl.h>
 #include <GL/glu.h>
 #include <GL/gl_integration.h>
 
 #define MAX_VERTICES 100
-#define MAX_FACES 200
+#define MAX_FACES (2*MAX_VERTICES - 4)
 #define NUM_BKGS 20
+#define HULL_EPS 1e-5f
+
+// Set to 1 to log how long the convex hull takes for increasing vertex counts
+#define HULL_BENCHMARK 0
 
 #define MAX_TIME  20.0f
 #define FADEIN_TIME 2.0f
@@ -30,6 +36,7 @@ typedef struct {
 
 typedef struct {
     int v1, v2, v3;
+    int adj[3];     // Faces across edges v1-v2, v2-v3 and v3-v1
     int color_idx;
 } Face;
 
@@ -55,7 +62,7 @@ Face faces[MAX_FACES];
 int num_vertices = 0;
 int num_faces = 0;
 rspq_block_t *poly = NULL;
-sprite_t *bkg[NUM_BKGS];
+AssetHandle bkg[NUM_BKGS];
 rdpq_font_t *font = NULL;
 #define FONT_TEXT 1
 
@@ -130,81 +137,291 @@ float dot_product(Vertex v1, Vertex v2) {
     return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
 }
 
-int is_convex(Vertex p, Vertex q, Vertex r, Vertex s) {
-    Vertex pq = subtract(q, p);
-    Vertex pr = subtract(r, p);
-    Vertex ps = subtract(s, p);
-    Vertex n = cross_product(pq, pr);
-    return dot_product(n, ps) >= 0;
+typedef struct {
+    int v[3];       // Counter-clockwise when seen from outside
+    int adj[3];     // Face across edge v[i] -> v[(i+1)%3]
+    Vertex normal;
+    float offset;
+    int outside;    // First vertex of the outside set, or -1
+    int visit;
+    bool alive;
+} HullFace;
+
+HullFace hull[MAX_FACES];
+int hull_free[MAX_FACES];
+int hull_num_free;
+int hull_visit;
+int outside_next[MAX_VERTICES];
+
+float hull_distance(HullFace *f, int p) {
+    return dot_product(f->normal, vertices[p]) - f->offset;
 }
 
-// Gift Wrapping (Jarvis March) for 3D convex hull
-void compute_convex_hull() {
-    assertf(num_vertices >= 4, "Too few points to create a polyhedron");
+int hull_new_face(int a, int b, int c) {
+    assertf(hull_num_free > 0, "Too many faces in the convex hull");
+    int f = hull_free[--hull_num_free];
+    HullFace *hf = &hull[f];
 
-    num_faces = 0;
-    
-    // Staring point: find the leftmost point
-    int start = 0;
+    Vertex n = cross_product(subtract(vertices[b], vertices[a]), subtract(vertices[c], vertices[a]));
+    float length = sqrtf(dot_product(n, n));
+    if (length > 0.0f) {
+        n.x /= length;
+        n.y /= length;
+        n.z /= length;
+    }
+
+    hf->v[0] = a; hf->v[1] = b; hf->v[2] = c;
+    hf->adj[0] = hf->adj[1] = hf->adj[2] = -1;
+    hf->normal = n;
+    hf->offset = dot_product(n, vertices[a]);
+    hf->outside = -1;
+    hf->visit = 0;
+    hf->alive = true;
+    return f;
+}
+
+void hull_free_face(int f) {
+    hull[f].alive = false;
+    hull_free[hull_num_free++] = f;
+}
+
+// Put the vertex in the outside set of the candidate face it is furthest above.
+// Vertices that are not above any candidate are inside the hull and get dropped.
+void hull_assign_outside(int p, int *candidates, int num_candidates) {
+    int best = -1;
+    float best_dist = HULL_EPS;
+    for (int i = 0; i < num_candidates; i++) {
+        float dist = hull_distance(&hull[candidates[i]], p);
+        if (dist > best_dist) {
+            best = candidates[i];
+            best_dist = dist;
+        }
+    }
+    if (best != -1) {
+        outside_next[p] = hull[best].outside;
+        hull[best].outside = p;
+    }
+}
+
+// Build the starting tetrahedron out of extreme points, and return its faces
+void hull_init_simplex(int *tet) {
+    int extremes[6] = { 0, 0, 0, 0, 0, 0 };
     for (int i = 1; i < num_vertices; i++) {
-        if (vertices[i].x < vertices[start].x) {
-            start = i;
+        if (vertices[i].x < vertices[extremes[0]].x) extremes[0] = i;
+        if (vertices[i].x > vertices[extremes[1]].x) extremes[1] = i;
+        if (vertices[i].y < vertices[extremes[2]].y) extremes[2] = i;
+        if (vertices[i].y > vertices[extremes[3]].y) extremes[3] = i;
+        if (vertices[i].z < vertices[extremes[4]].z) extremes[4] = i;
+        if (vertices[i].z > vertices[extremes[5]].z) extremes[5] = i;
+    }
+
+    // The two extremes furthest apart
+    int p0 = extremes[0], p1 = extremes[1];
+    float best = -1.0f;
+    for (int i = 0; i < 6; i++) {
+        for (int j = i + 1; j < 6; j++) {
+            Vertex d = subtract(vertices[extremes[j]], vertices[extremes[i]]);
+            if (dot_product(d, d) > best) {
+                best = dot_product(d, d);
+                p0 = extremes[i];
+                p1 = extremes[j];
+            }
         }
     }
 
-    int p = start;
-    do {
-        for (int i = 0; i < num_vertices; i++) {
-            for (int j = i + 1; j < num_vertices; j++) {
-                if (i != p && j != p) {
-                    int found = 1;
-                    for (int k = 0; k < num_vertices; k++) {
-                        if (k != p && k != i && k != j && !is_convex(vertices[p], vertices[i], vertices[j], vertices[k])) {
-                            found = 0;
-                            break;
-                        }
-                    }
-                    if (found) {
-                        faces[num_faces].v1 = p;
-                        faces[num_faces].v2 = i;
-                        faces[num_faces].v3 = j;
-                        num_faces++;
-                    }
+    // The point furthest from that line
+    int p2 = -1;
+    best = HULL_EPS;
+    Vertex dir = subtract(vertices[p1], vertices[p0]);
+    for (int i = 0; i < num_vertices; i++) {
+        Vertex c = cross_product(subtract(vertices[i], vertices[p0]), dir);
+        if (dot_product(c, c) > best) {
+            best = dot_product(c, c);
+            p2 = i;
+        }
+    }
+    assertf(p2 != -1, "All the points of the polyhedron are collinear");
+
+    // The point furthest from that plane
+    int p3 = -1;
+    best = HULL_EPS;
+    Vertex n = cross_product(dir, subtract(vertices[p2], vertices[p0]));
+    for (int i = 0; i < num_vertices; i++) {
+        float dist = fabsf(dot_product(n, subtract(vertices[i], vertices[p0])));
+        if (dist > best) {
+            best = dist;
+            p3 = i;
+        }
+    }
+    assertf(p3 != -1, "All the points of the polyhedron are coplanar");
+
+    int pts[4] = { p0, p1, p2, p3 };
+    for (int i = 0; i < 4; i++) {
+        int a = pts[(i+1)%4], b = pts[(i+2)%4], c = pts[(i+3)%4];
+        tet[i] = hull_new_face(a, b, c);
+        // Flip the face if it looks towards the opposite vertex
+        if (hull_distance(&hull[tet[i]], pts[i]) > 0.0f) {
+            hull_free_face(tet[i]);
+            tet[i] = hull_new_face(a, c, b);
+        }
+    }
+
+    // Link the faces that share an edge
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (i == j) continue;
+            HullFace *fi = &hull[tet[i]], *fj = &hull[tet[j]];
+            for (int e = 0; e < 3; e++) {
+                for (int k = 0; k < 3; k++) {
+                    if (fi->v[e] == fj->v[(k+1)%3] && fi->v[(e+1)%3] == fj->v[k])
+                        fi->adj[e] = tet[j];
                 }
             }
         }
-        p++;
-        if (p == num_vertices) {
-            p = 0;
-        }
-    } while (p != start && num_faces < MAX_FACES);
+    }
 }
 
-void color_polyhedron(void) {
-    int are_faces_adjacent(Face *f1, Face *f2) {
-        int shared_vertices = 0;
-        if (f1->v1 == f2->v1 || f1->v1 == f2->v2 || f1->v1 == f2->v3) shared_vertices++;
-        if (f1->v2 == f2->v1 || f1->v2 == f2->v2 || f1->v2 == f2->v3) shared_vertices++;
-        if (f1->v3 == f2->v1 || f1->v3 == f2->v2 || f1->v3 == f2->v3) shared_vertices++;
-
-        return (shared_vertices == 2);
-    }    
-    
-    int is_valid_color(Face *faces, int face_index, int color_index, int num_faces) {
-        for (int i = 0; i < num_faces; i++) {
-            if (i == face_index) continue;
-            if (are_faces_adjacent(&faces[face_index], &faces[i]) && faces[i].color_idx == color_index)
-                return false;
+// Quickhull: repeatedly grow the hull towards the furthest point outside one of its faces
+void compute_convex_hull() {
+    assertf(num_vertices >= 4, "Too few points to create a polyhedron");
+
+    for (int i = 0; i < MAX_FACES; i++) {
+        hull[i].alive = false;
+        hull_free[i] = MAX_FACES - 1 - i;
+    }
+    hull_num_free = MAX_FACES;
+    hull_visit = 0;
+
+    int tet[4];
+    hull_init_simplex(tet);
+    for (int i = 0; i < num_vertices; i++)
+        hull_assign_outside(i, tet, 4);
+
+    int pending[MAX_FACES];
+    int num_pending = 0;
+    for (int i = 0; i < 4; i++)
+        if (hull[tet[i]].outside != -1) pending[num_pending++] = tet[i];
+
+    int visible[MAX_FACES];
+    int horizon[MAX_FACES][3];
+    int orphans[MAX_VERTICES];
+    int new_faces[MAX_FACES];
+    int new_by_start[MAX_VERTICES];
+    int new_by_end[MAX_VERTICES];
+
+    while (num_pending > 0) {
+        int f = pending[--num_pending];
+        if (!hull[f].alive || hull[f].outside == -1) continue;
+
+        // Pop the furthest point out of the outside set
+        int eye = -1, prev = -1, eye_prev = -1;
+        float best = -1.0f;
+        for (int p = hull[f].outside; p != -1; prev = p, p = outside_next[p]) {
+            float dist = hull_distance(&hull[f], p);
+            if (dist > best) {
+                best = dist;
+                eye = p;
+                eye_prev = prev;
+            }
+        }
+        if (eye_prev == -1) hull[f].outside = outside_next[eye];
+        else outside_next[eye_prev] = outside_next[eye];
+
+        // Flood the faces that can see the eye point
+        int num_visible = 1;
+        visible[0] = f;
+        hull[f].visit = ++hull_visit;
+        for (int i = 0; i < num_visible; i++) {
+            HullFace *vf = &hull[visible[i]];
+            for (int e = 0; e < 3; e++) {
+                int g = vf->adj[e];
+                if (hull[g].visit != hull_visit && hull_distance(&hull[g], eye) > HULL_EPS) {
+                    hull[g].visit = hull_visit;
+                    visible[num_visible++] = g;
+                }
+            }
         }
-        return true;
+
+        // Collect the horizon edges and the points left without a face
+        int num_horizon = 0, num_orphans = 0;
+        for (int i = 0; i < num_visible; i++) {
+            HullFace *vf = &hull[visible[i]];
+            for (int e = 0; e < 3; e++) {
+                int g = vf->adj[e];
+                if (hull[g].visit == hull_visit) continue;
+                horizon[num_horizon][0] = vf->v[e];
+                horizon[num_horizon][1] = vf->v[(e+1)%3];
+                horizon[num_horizon][2] = g;
+                num_horizon++;
+
+                // Detach the neighbour from the face that is going away
+                for (int k = 0; k < 3; k++)
+                    if (hull[g].adj[k] == visible[i]) hull[g].adj[k] = -1;
+            }
+            for (int p = vf->outside; p != -1; p = outside_next[p])
+                orphans[num_orphans++] = p;
+        }
+        for (int i = 0; i < num_visible; i++)
+            hull_free_face(visible[i]);
+
+        // Cone from the horizon to the eye point
+        for (int i = 0; i < num_horizon; i++) {
+            int a = horizon[i][0], b = horizon[i][1], g = horizon[i][2];
+            int nf = hull_new_face(a, b, eye);
+            new_faces[i] = nf;
+            new_by_start[a] = nf;
+            new_by_end[b] = nf;
+
+            hull[nf].adj[0] = g;
+            for (int k = 0; k < 3; k++) {
+                if (hull[g].adj[k] == -1 && hull[g].v[k] == b && hull[g].v[(k+1)%3] == a) {
+                    hull[g].adj[k] = nf;
+                    break;
+                }
+            }
+        }
+        for (int i = 0; i < num_horizon; i++) {
+            HullFace *nf = &hull[new_faces[i]];
+            nf->adj[1] = new_by_start[nf->v[1]];
+            nf->adj[2] = new_by_end[nf->v[0]];
+        }
+
+        for (int i = 0; i < num_orphans; i++)
+            hull_assign_outside(orphans[i], new_faces, num_horizon);
+        for (int i = 0; i < num_horizon; i++)
+            if (hull[new_faces[i]].outside != -1) pending[num_pending++] = new_faces[i];
     }
 
+    // Compact the hull into the face list. Faces are stored with the
+    // opposite winding, which is the one the renderer expects.
+    int remap[MAX_FACES];
+    num_faces = 0;
+    for (int i = 0; i < MAX_FACES; i++)
+        if (hull[i].alive) remap[i] = num_faces++;
+    for (int i = 0; i < MAX_FACES; i++) {
+        if (!hull[i].alive) continue;
+        Face *face = &faces[remap[i]];
+        face->v1 = hull[i].v[0];
+        face->v2 = hull[i].v[2];
+        face->v3 = hull[i].v[1];
+        face->adj[0] = remap[hull[i].adj[2]];
+        face->adj[1] = remap[hull[i].adj[1]];
+        face->adj[2] = remap[hull[i].adj[0]];
+    }
+}
+
+void color_polyhedron(void) {
+    for (int i = 0; i < num_faces; i++)
+        faces[i].color_idx = -1;
 
     for (int i = 0; i < num_faces; i++) {
         int idx = rand() % PALETTE_SIZE;
         for (int c = 0; c < PALETTE_SIZE; c++) {
-            if (is_valid_color(faces, i, (idx+c)%PALETTE_SIZE, num_faces)) {
-                faces[i].color_idx = (idx+c) % PALETTE_SIZE;
+            int color = (idx+c) % PALETTE_SIZE;
+            if (faces[faces[i].adj[0]].color_idx != color &&
+                faces[faces[i].adj[1]].color_idx != color &&
+                faces[faces[i].adj[2]].color_idx != color) {
+                faces[i].color_idx = color;
                 break;
             }
         }
@@ -236,6 +453,7 @@ void draw_polyhedron(void)
 }
 
 void generate_random_polyhedron(int num_vertices_input, float range_min, float range_max) {
+    assertf(num_vertices_input <= MAX_VERTICES, "Too many points to create a polyhedron");
     num_vertices = num_vertices_input;
     for (int i = 0; i < num_vertices; i++) {
         vertices[i] = random_vertex(range_min, range_max);
@@ -251,6 +469,29 @@ void generate_random_polyhedron(int num_vertices_input, float range_min, float r
     cur_bkg = rand() % NUM_BKGS;
 }
 
+#if HULL_BENCHMARK
+void benchmark_convex_hull(void)
+{
+    const int counts[] = { 8, 16, 32, 64, MAX_VERTICES };
+    const int runs = 16;
+
+    for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        uint64_t total = 0;
+        num_vertices = counts[i];
+        for (int r = 0; r < runs; r++) {
+            for (int v = 0; v < num_vertices; v++)
+                vertices[v] = random_vertex(-1.0f, 1.0f);
+            uint64_t start = get_ticks();
+            compute_convex_hull();
+            color_polyhedron();
+            total += get_ticks() - start;
+        }
+        debugf("Hull: %3d vertices, %3d faces, %6llu us\n",
+            num_vertices, num_faces, (unsigned long long)TICKS_TO_US(total / runs));
+    }
+}
+#endif
+
 float gauss_random(float mean, float stddev) {
     static int has_spare = 0;
     static float spare;    
@@ -341,14 +582,19 @@ void minigame_init()
     glLoadIdentity();
     gluPerspective(45.0, (GLfloat)w / (GLfloat)h, near_plane, far_plane);
 
+    #if HULL_BENCHMARK
+    benchmark_convex_hull();
+    #endif
+
     int num_vertices = rand() % 10 + 5;
     generate_random_polyhedron(num_vertices, -1.0f, 1.0f);
 
     for (int i=0; i<NUM_BKGS; i++) {
         char fn[64];
         sprintf(fn, "rom:/polyquiz/plaster%d.ci4.sprite", i+1);
-        bkg[i] = sprite_load(fn);
+        assethandle_init(&bkg[i], ASSETTYPE_SPRITE, fn);
     }
+    assethandle_get_sprite(&bkg[cur_bkg]);
     font = rdpq_font_load("rom:/polyquiz/abaddon.font64");
     rdpq_text_register_font(FONT_TEXT, font);
     rdpq_font_style(font, 0, &(rdpq_fontstyle_t){
@@ -375,7 +621,7 @@ void minigame_cleanup()
     rdpq_text_unregister_font(FONT_TEXT);
     rdpq_font_free(font);
     for (int i=0; i<NUM_BKGS; i++) {
-        sprite_free(bkg[i]);
+        assethandle_release(&bkg[i]);
     }
     if (poly) rspq_block_free(poly);
     gl_close();
@@ -475,7 +721,7 @@ void minigame_loop(float dt)
     rdpq_attach(disp, NULL);
 
     rdpq_set_mode_copy(false);
-    rdpq_sprite_upload(TILE0, bkg[cur_bkg], &(rdpq_texparms_t){
+    rdpq_sprite_upload(TILE0, assethandle_get_sprite(&bkg[cur_bkg]), &(rdpq_texparms_t){
         .s.repeats = REPEAT_INFINITE, .t.repeats = REPEAT_INFINITE,
     });
     rdpq_texture_rectangle(TILE0, 0, 0, display_get_width(), display_get_height(), 0, 0);
@@ -498,21 +744,21 @@ void minigame_loop(float dt)
     rdpq_set_mode_standard();
     switch (state) {
     case GS_FADEIN:
-        rdpq_text_printf(&(rdpq_textparms_t){
+        textcache_printf(&(rdpq_textparms_t){
             .width = display_get_width(), .align = ALIGN_CENTER,
         }, FONT_TEXT, 0, 50, "Guess the number of faces!");
         break;
     case GS_PLAY: {
         char buf[16];
         sprintf(buf, "%02d:%02d", (int)state_time, (int)((state_time - (int)state_time) * 100));
-        rdpq_text_printf(NULL, FONT_TEXT, 250, 50, "%c", buf[0]);
-        rdpq_text_printf(NULL, FONT_TEXT, 270, 50, "%c", buf[1]);
-        rdpq_text_printf(NULL, FONT_TEXT, 295, 50, "%c", ':');
-        rdpq_text_printf(NULL, FONT_TEXT, 310, 50, "%c", buf[3]);
-        rdpq_text_printf(NULL, FONT_TEXT, 330, 50, "%c", buf[4]);
+        textcache_printf(NULL, FONT_TEXT, 250, 50, "%c", buf[0]);
+        textcache_printf(NULL, FONT_TEXT, 270, 50, "%c", buf[1]);
+        textcache_printf(NULL, FONT_TEXT, 295, 50, "%c", ':');
+        textcache_printf(NULL, FONT_TEXT, 310, 50, "%c", buf[3]);
+        textcache_printf(NULL, FONT_TEXT, 330, 50, "%c", buf[4]);
     }   break;
     case GS_RESULT:
-        rdpq_text_printf(&(rdpq_textparms_t){
+        textcache_printf(&(rdpq_textparms_t){
             .width = display_get_width(), .align = ALIGN_CENTER,
         }, FONT_TEXT, 0, 50, "Faces: %d", num_faces);
 
@@ -530,12 +776,12 @@ void minigame_loop(float dt)
         }
 
         if (closest != -1) {
-            rdpq_text_printf(&(rdpq_textparms_t){
+            textcache_printf(&(rdpq_textparms_t){
                 .width = display_get_width(), .align = ALIGN_CENTER,
                 .style_id = 1,
             }, FONT_TEXT, 0, 240, "Player %d wins!", closest+1);
         } else {
-            rdpq_text_printf(&(rdpq_textparms_t){
+            textcache_printf(&(rdpq_textparms_t){
                 .width = display_get_width(), .align = ALIGN_CENTER,
                 .style_id = 1,
             }, FONT_TEXT, 0, 240, "Nobody wins");
@@ -550,7 +796,7 @@ void minigame_loop(float dt)
             rdpq_textparms_t parms = {
                 .style_id = player[i].confirmed ? 1 : (state == GS_PLAY ? 0 : 2),
             };
-            rdpq_text_printf(&parms, FONT_TEXT, 100+i*140, 460, "%d", player[i].guess);
+            textcache_print_int(FONT_TEXT, parms.style_id, 100+i*140, 460, player[i].guess);
         }
     }
 
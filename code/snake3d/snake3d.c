@@ -1,6 +1,8 @@
 #include <libdragon.h>
 #include "../../minigame.h"
 #include "../../core.h"
+#include "../../matrixpool.h"
+#include "../../interp.h"
 #include <t3d/t3d.h>
 #include <t3d/t3dmath.h>
 #include <t3d/t3dmodel.h>
@@ -45,6 +47,7 @@ surface_t *depthBuffer;
 T3DViewport viewport;
 rdpq_font_t *font;
 rdpq_font_t *fontBillboard;
+MatrixPool matPool;
 T3DMat4FP* mapMatFP;
 rspq_block_t *dplMap;
 T3DModel *model;
@@ -93,7 +96,7 @@ rspq_syncpoint_t syncPoint;
 
 void player_init(player_data *player, color_t color, T3DVec3 position, float rotation)
 {
-  player->modelMatFP = malloc_uncached(sizeof(T3DMat4FP));
+  player->modelMatFP = matrixpool_alloc(&matPool);
 
   player->moveDir = (T3DVec3){{0,0,0}};
   player->playerPos = position;
@@ -136,6 +139,10 @@ void player_init(player_data *player, color_t color, T3DVec3 position, float rot
   player->isAlive = true;
   player->ai_target = rand()%MAXPLAYERS;
   player->ai_reactionspeed = (2-core_get_aidifficulty())*5 + rand()%((3-core_get_aidifficulty())*3);
+
+  // Movement happens in the fixed loop, so draw it blended between ticks
+  interp_register(player->playerPos.v, 3, INTERP_LINEAR);
+  interp_register(&player->rotY, 1, INTERP_ANGLE);
 }
 
 void minigame_init(void)
@@ -165,7 +172,8 @@ void minigame_init(void)
 
   viewport = t3d_viewport_create();
 
-  mapMatFP = malloc_uncached(sizeof(T3DMat4FP));
+  matrixpool_init(&matPool, MAXPLAYERS+1, 1);
+  mapMatFP = matrixpool_alloc(&matPool);
   t3d_mat4fp_from_srt_euler(mapMatFP, (float[3]){0.3f, 0.3f, 0.3f}, (float[3]){0, 0, 0}, (float[3]){0, 0, -10});
 
   camPos = (T3DVec3){{0, 125.0f, 100.0f}};
@@ -370,10 +378,12 @@ void player_loop(player_data *player, float deltaTime, joypad_port_t port, bool
   t3d_skeleton_update(&player->skel);
 
   // Update player matrix
+  T3DVec3 drawPos;
+  interp_get(player->playerPos.v, drawPos.v);
   t3d_mat4fp_from_srt_euler(player->modelMatFP,
     (float[3]){0.125f, 0.125f, 0.125f},
-    (float[3]){0.0f, -player->rotY, 0},
-    player->playerPos.v
+    (float[3]){0.0f, -interp_get_float(&player->rotY), 0},
+    drawPos.v
   );
 }
 
@@ -388,11 +398,9 @@ void player_draw_billboard(player_data *player, PlyNum playerNum)
 {
   if (!player->isAlive) return;
 
-  T3DVec3 billboardPos = (T3DVec3){{
-    player->playerPos.v[0],
-    player->playerPos.v[1] + BILLBOARD_YOFFSET,
-    player->playerPos.v[2]
-  }};
+  T3DVec3 billboardPos;
+  interp_get(player->playerPos.v, billboardPos.v);
+  billboardPos.v[1] += BILLBOARD_YOFFSET;
 
   T3DVec3 billboardScreenPos;
   t3d_viewport_calc_viewspace_pos(&viewport, &billboardScreenPos, &billboardPos);
@@ -521,7 +529,7 @@ void player_cleanup(player_data *player)
   t3d_anim_destroy(&player->animWalk);
   t3d_anim_destroy(&player->animAttack);
 
-  free_uncached(player->modelMatFP);
+  matrixpool_release(&matPool, player->modelMatFP);
 }
 
 void minigame_cleanup(void)
@@ -543,7 +551,8 @@ void minigame_cleanup(void)
   t3d_model_free(modelMap);
   t3d_model_free(modelShadow);
 
-  free_uncached(mapMatFP);
+  matrixpool_release(&matPool, mapMatFP);
+  matrixpool_free(&matPool);
 
   rdpq_text_unregister_font(FONT_BILLBOARD);
   rdpq_font_free(fontBillboard);
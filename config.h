@@ -25,4 +25,19 @@
     // The current minigame you want to test
     #define MINIGAME_TO_TEST  "examplegame"
 
+    // Count the syncs, mode changes and texture uploads of every rstat_ call site (see renderstats.h)
+    #define RENDER_STATS  0
+
+    // Before the menu, play every wav64 and xm64 in the ROM on its own and log what each costs (see audiobench.h)
+    #define AUDIO_BENCHMARK  0
+
+    // Lock the frame rate to 30 or 60, showing every frame for the same number of vertical blanks. 0 leaves it unlocked.
+    #define TARGET_FPS  0
+
+    // The most fixed loop ticks run in one frame. Any more than this are dropped, slowing the game down instead.
+    #define MAX_CATCHUP_TICKS  4
+
+    // Time how long button presses take to show up on screen, and log it when each minigame ends (see latencyprobe.h)
+    #define LATENCY_PROBE  0
+
 #endif
\ No newline at end of file
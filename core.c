@@ -8,6 +8,16 @@ player, AI, and game loop information.
 #include <libdragon.h>
 #include "core.h"
 #include "config.h"
+#include "iosched.h"
+
+
+/*********************************
+             Macros
+*********************************/
+
+// The audio interface is busy while it still has samples to play
+#define AI_STATUS       ((volatile uint32_t*)0xA450000C)
+#define AI_STATUS_BUSY  (1 << 30)
 
 
 /*********************************
@@ -34,6 +44,16 @@ static bool global_core_playeriswinner[MAXPLAYERS];
 
 // Core info
 static double global_core_subtick = 0;
+static bool   global_core_staticframe = false;
+static uint32_t global_core_missedvsyncs = 0;
+static uint32_t global_core_droppedticks = 0;
+
+// Audio info
+static uint32_t global_core_audiounderruns = 0;
+static bool     global_core_audioprimed = false;
+static int      global_core_audiofrequency = 0;
+static int      global_core_audiobuffers = 0;
+static int      global_core_audiochannels = 0;
 
 
 /*==============================
@@ -103,6 +123,31 @@ void core_set_winner(PlyNum ply)
 }
 
 
+/*==============================
+    core_set_staticframe
+    Tells the core that the screen isn't changing, so the
+    loop should be paced without rendering new frames
+    @param  Whether the frame on screen is static
+==============================*/
+
+void core_set_staticframe(bool enabled)
+{
+    global_core_staticframe = enabled;
+}
+
+
+/*==============================
+    core_get_staticframe
+    Checks if the minigame is presenting a static frame
+    @return Whether the frame on screen is static
+==============================*/
+
+bool core_get_staticframe()
+{
+    return global_core_staticframe;
+}
+
+
 /*==============================
     core_get_aidifficulty
     Gets the current AI difficulty
@@ -163,4 +208,174 @@ void core_reset_winners()
 {
     for (int i=0; i<MAXPLAYERS; i++)
         global_core_playeriswinner[i] = false;
-}
\ No newline at end of file
+}
+
+/*==============================
+    core_audio_pump
+    Fills the audio buffers that have finished playing.
+    The core calls this several times per frame, but you
+    can also call it during long operations, like loading
+    a lot of assets at once, so that the audio doesn't
+    run out. It stops once AUDIO_PUMP_BUDGET_US is spent.
+==============================*/
+
+void core_audio_pump()
+{
+    int filled = 0;
+    uint32_t start;
+
+    iosched_audiopumped();
+
+    // Every buffer being free leaves the audio interface idle, so check that before filling any.
+    // Right after audio_init nothing was ever queued, so that doesn't count.
+    if (global_core_audioprimed && !(*AI_STATUS & AI_STATUS_BUSY))
+        global_core_audiounderruns++;
+
+    start = get_ticks();
+    while (filled < global_core_audiobuffers && audio_can_write())
+    {
+        short* buffer = audio_write_begin();
+        mixer_poll(buffer, audio_get_buffer_length());
+        audio_write_end();
+        filled++;
+        if (TICKS_DISTANCE(start, get_ticks()) > TICKS_FROM_US(AUDIO_PUMP_BUDGET_US))
+            break;
+    }
+    if (filled > 0)
+        global_core_audioprimed = true;
+}
+
+
+/*==============================
+    core_get_audio_underruns
+    Gets how many times the audio ran out of samples
+    since the console was turned on
+    @return The number of underruns
+==============================*/
+
+uint32_t core_get_audio_underruns()
+{
+    return global_core_audiounderruns;
+}
+
+
+/*==============================
+    core_set_audio
+    Sets up the audio and the mixer for a minigame, only
+    restarting them if something changed since the last one
+    @param  The output sample rate, or 0 for the default
+    @param  The number of audio buffers, or 0 for the default
+    @param  The number of mixer channels, or 0 for the default
+    @param  The highest sample rate of any channel, or 0 if unknown
+==============================*/
+
+void core_set_audio(int frequency, int buffers, int channels, int maxfrequency)
+{
+    bool restartaudio;
+    if (frequency == 0)
+        frequency = AUDIO_FREQUENCY;
+    if (buffers == 0)
+        buffers = AUDIO_BUFFERS;
+    if (channels == 0)
+        channels = AUDIO_CHANNELS;
+    assertf(channels <= 32, "The mixer has at most 32 channels, not %d", channels);
+
+    restartaudio = frequency != global_core_audiofrequency || buffers != global_core_audiobuffers;
+    if (restartaudio || channels != global_core_audiochannels)
+    {
+        // The mixer takes its sample rate from the audio, so it must be restarted with it
+        if (global_core_audiochannels != 0)
+            mixer_close();
+        if (restartaudio)
+        {
+            if (global_core_audiofrequency != 0)
+                audio_close();
+            audio_init(frequency, buffers);
+            global_core_audioprimed = false;
+        }
+        mixer_init(channels);
+        global_core_audiofrequency = frequency;
+        global_core_audiobuffers = buffers;
+        global_core_audiochannels = channels;
+    }
+
+    // Smaller limits mean smaller channel buffers
+    for (int i=0; i<channels; i++)
+        mixer_ch_set_limits(i, 0, maxfrequency, 0);
+}
+
+
+/*==============================
+    core_get_audio_channels
+    Gets how many mixer channels the current minigame has
+    @return The number of channels
+==============================*/
+
+int core_get_audio_channels()
+{
+    return global_core_audiochannels;
+}
+
+
+/*==============================
+    core_get_missedvsyncs
+    Gets how many vertical blanks frames were late by
+    since the minigame started, when TARGET_FPS locks
+    the frame rate
+    @return The number of missed vertical blanks
+==============================*/
+
+uint32_t core_get_missedvsyncs()
+{
+    return global_core_missedvsyncs;
+}
+
+
+/*==============================
+    core_get_droppedticks
+    Gets how many fixed loop ticks were skipped since the
+    minigame started, because the game fell more than
+    MAX_CATCHUP_TICKS behind
+    @return The number of dropped ticks
+==============================*/
+
+uint32_t core_get_droppedticks()
+{
+    return global_core_droppedticks;
+}
+
+
+/*==============================
+    core_add_missedvsyncs
+    Counts vertical blanks that a frame was late by
+    @param  The number of missed vertical blanks
+==============================*/
+
+void core_add_missedvsyncs(uint32_t count)
+{
+    global_core_missedvsyncs += count;
+}
+
+
+/*==============================
+    core_add_droppedticks
+    Counts fixed loop ticks that were skipped
+    @param  The number of dropped ticks
+==============================*/
+
+void core_add_droppedticks(uint32_t count)
+{
+    global_core_droppedticks += count;
+}
+
+
+/*==============================
+    core_reset_framestats
+    Resets the missed vertical blanks and dropped ticks
+==============================*/
+
+void core_reset_framestats()
+{
+    global_core_missedvsyncs = 0;
+    global_core_droppedticks = 0;
+}
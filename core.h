@@ -76,6 +76,53 @@ extern "C" {
     ==============================*/
     void core_set_winner(PlyNum ply);
 
+    /*==============================
+        core_set_staticframe
+        Tells the core that the screen isn't changing, like
+        while paused. While enabled, your loop is still called
+        once per vertical blank, but it doesn't need to render
+        anything. Disable it again once you have something new
+        to show. It is disabled when your minigame ends.
+        @param  Whether the frame on screen is static
+    ==============================*/
+    void core_set_staticframe(bool enabled);
+
+    /*==============================
+        core_get_missedvsyncs
+        Gets how many vertical blanks frames were late by
+        since the minigame started, when TARGET_FPS locks
+        the frame rate
+        @return The number of missed vertical blanks
+    ==============================*/
+    uint32_t core_get_missedvsyncs();
+
+    /*==============================
+        core_get_droppedticks
+        Gets how many fixed loop ticks were skipped since the
+        minigame started, because the game fell more than
+        MAX_CATCHUP_TICKS behind
+        @return The number of dropped ticks
+    ==============================*/
+    uint32_t core_get_droppedticks();
+
+    /*==============================
+        core_audio_pump
+        Fills the audio buffers that have finished playing.
+        The core calls this several times per frame, but you
+        can also call it during long operations, like loading
+        a lot of assets at once, so that the audio doesn't
+        run out. It stops once AUDIO_PUMP_BUDGET_US is spent.
+    ==============================*/
+    void core_audio_pump();
+
+    /*==============================
+        core_get_audio_underruns
+        Gets how many times the audio ran out of samples
+        since the console was turned on
+        @return The number of underruns
+    ==============================*/
+    uint32_t core_get_audio_underruns();
+
     
     /***************************************************************
                         Internal Core Functions
@@ -87,10 +134,21 @@ extern "C" {
 
     #define MAXPLAYERS  4
 
+    #define AUDIO_FREQUENCY       32000
+    #define AUDIO_BUFFERS         3
+    #define AUDIO_CHANNELS        32
+    #define AUDIO_PUMP_BUDGET_US  2000
+
     void core_set_playercount(uint32_t playercount);
     void core_set_aidifficulty(AiDiff difficulty);
     void core_set_subtick(double subtick);
     void core_reset_winners();
+    void core_reset_framestats();
+    void core_add_missedvsyncs(uint32_t count);
+    void core_add_droppedticks(uint32_t count);
+    bool core_get_staticframe();
+    void core_set_audio(int frequency, int buffers, int channels, int maxfrequency);
+    int  core_get_audio_channels();
 
 #ifdef __cplusplus
 }
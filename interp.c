@@ -0,0 +1,192 @@
+/***************************************************************
+                           interp.c
+
+Keeps the last two ticks of the state that minigames register,
+and blends between them so that drawing at a higher rate than
+the fixed loop doesn't judder.
+***************************************************************/
+
+#include <libdragon.h>
+#include <math.h>
+#include <string.h>
+#include "core.h"
+#include "interp.h"
+
+
+/*********************************
+             Structs
+*********************************/
+
+typedef struct {
+    const float* values;
+    int count;
+    InterpKind kind;
+    float previous[INTERP_MAXVALUES];
+    float current[INTERP_MAXVALUES];
+} InterpEntry;
+
+
+/*********************************
+             Globals
+*********************************/
+
+static InterpEntry global_interp_entries[INTERP_MAXENTRIES];
+static int global_interp_count = 0;
+
+
+/*==============================
+    interp_find
+    Finds the entry of a piece of registered state
+    @param  The values that were registered
+    @return The entry
+==============================*/
+
+static InterpEntry* interp_find(const float* values)
+{
+    for (int i=0; i<global_interp_count; i++)
+        if (global_interp_entries[i].values == values)
+            return &global_interp_entries[i];
+    assertf(0, "Interpolated state %p was never registered", values);
+    return NULL;
+}
+
+
+/*==============================
+    interp_register
+    Starts keeping track of a piece of state that is
+    written by the fixed loop. Both of its copies start
+    with the current values.
+    @param  The values to keep track of. They must stay
+            valid until the minigame ends.
+    @param  How many floats there are
+    @param  How they are blended
+==============================*/
+
+void interp_register(const float* values, int count, InterpKind kind)
+{
+    InterpEntry* entry;
+    assertf(count > 0 && count <= INTERP_MAXVALUES, "Can't interpolate %d values, the limit is %d", count, INTERP_MAXVALUES);
+    assertf(kind != INTERP_QUAT || count == 4, "A quaternion needs 4 values, not %d", count);
+    assertf(global_interp_count < INTERP_MAXENTRIES, "Too many interpolated states, the limit is %d", INTERP_MAXENTRIES);
+
+    entry = &global_interp_entries[global_interp_count++];
+    entry->values = values;
+    entry->count = count;
+    entry->kind = kind;
+    memcpy(entry->current, values, count*sizeof(float));
+    memcpy(entry->previous, values, count*sizeof(float));
+}
+
+
+/*==============================
+    interp_snap
+    Makes a piece of state jump to its current values
+    instead of blending into them, for instance after a
+    respawn or a camera cut
+    @param  The values that were registered
+==============================*/
+
+void interp_snap(const float* values)
+{
+    InterpEntry* entry = interp_find(values);
+    memcpy(entry->current, values, entry->count*sizeof(float));
+    memcpy(entry->previous, values, entry->count*sizeof(float));
+}
+
+
+/*==============================
+    interp_get
+    Gets a piece of state blended between the last two
+    ticks by the current subtick
+    @param  The values that were registered
+    @param  Where to store the blended values
+==============================*/
+
+void interp_get(const float* values, float* out)
+{
+    InterpEntry* entry = interp_find(values);
+    float t = core_get_subtick();
+    if (t > 1.0f)
+        t = 1.0f;
+
+    switch (entry->kind)
+    {
+        case INTERP_LINEAR:
+            for (int i=0; i<entry->count; i++)
+                out[i] = entry->previous[i] + (entry->current[i] - entry->previous[i])*t;
+            break;
+        case INTERP_ANGLE:
+            for (int i=0; i<entry->count; i++)
+            {
+                float diff = fmodf(entry->current[i] - entry->previous[i], 2*M_PI);
+                if (diff > M_PI)
+                    diff -= 2*M_PI;
+                else if (diff < -M_PI)
+                    diff += 2*M_PI;
+                out[i] = entry->previous[i] + diff*t;
+            }
+            break;
+        case INTERP_QUAT:
+        {
+            float dot = 0, len = 0;
+            float sign;
+            for (int i=0; i<4; i++)
+                dot += entry->previous[i]*entry->current[i];
+            sign = dot < 0 ? -1.0f : 1.0f;
+            for (int i=0; i<4; i++)
+            {
+                out[i] = entry->previous[i]*(1.0f - t) + sign*entry->current[i]*t;
+                len += out[i]*out[i];
+            }
+            len = len > 0 ? 1.0f/sqrtf(len) : 0;
+            for (int i=0; i<4; i++)
+                out[i] *= len;
+            break;
+        }
+    }
+}
+
+
+/*==============================
+    interp_get_float
+    Gets a single registered value blended between the
+    last two ticks by the current subtick
+    @param  The value that was registered
+    @return The blended value
+==============================*/
+
+float interp_get_float(const float* value)
+{
+    float out[INTERP_MAXVALUES];
+    interp_get(value, out);
+    return out[0];
+}
+
+
+/*==============================
+    interp_tick
+    Moves every registered state along by one tick.
+    Called by the core after every fixed loop.
+==============================*/
+
+void interp_tick()
+{
+    for (int i=0; i<global_interp_count; i++)
+    {
+        InterpEntry* entry = &global_interp_entries[i];
+        memcpy(entry->previous, entry->current, entry->count*sizeof(float));
+        memcpy(entry->current, entry->values, entry->count*sizeof(float));
+    }
+}
+
+
+/*==============================
+    interp_reset
+    Forgets every registered state.
+    Called by the core when a minigame ends.
+==============================*/
+
+void interp_reset()
+{
+    global_interp_count = 0;
+}
@@ -0,0 +1,95 @@
+#ifndef GAMEJAM2024_INTERP_H
+#define GAMEJAM2024_INTERP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+    /***************************************************************
+                    Public Interpolation Constants
+    ***************************************************************/
+
+    // How many pieces of state can be registered at once
+    #define INTERP_MAXENTRIES  64
+
+    // The most floats a single piece of state can have
+    #define INTERP_MAXVALUES   8
+
+    // How the values of a piece of state are blended
+    typedef enum {
+        INTERP_LINEAR = 0,  // Any number of plain values, like a position or a camera
+        INTERP_ANGLE,       // Angles in radians, blended the short way around
+        INTERP_QUAT,        // A quaternion of 4 floats, blended the short way and normalized
+    } InterpKind;
+
+
+    /***************************************************************
+                    Public Interpolation Functions
+    ***************************************************************/
+
+    /*
+        Your fixed loop only runs TICKRATE times per second, so anything
+        drawn straight from its state moves in steps when the frame rate
+        is higher. Register the state that your fixed loop writes once in
+        your init function, and the core remembers its values from the
+        last two ticks. When drawing, ask for the blended values instead
+        of reading the state directly. The blend lags one tick behind,
+        but it always moves smoothly. Everything registered is forgotten
+        when your minigame ends. It only works for minigames with a
+        fixed loop.
+    */
+
+    /*==============================
+        interp_register
+        Starts keeping track of a piece of state that is
+        written by the fixed loop. Both of its copies start
+        with the current values.
+        @param  The values to keep track of. They must stay
+                valid until the minigame ends.
+        @param  How many floats there are
+        @param  How they are blended
+    ==============================*/
+    void interp_register(const float* values, int count, InterpKind kind);
+
+    /*==============================
+        interp_snap
+        Makes a piece of state jump to its current values
+        instead of blending into them, for instance after a
+        respawn or a camera cut
+        @param  The values that were registered
+    ==============================*/
+    void interp_snap(const float* values);
+
+    /*==============================
+        interp_get
+        Gets a piece of state blended between the last two
+        ticks by the current subtick
+        @param  The values that were registered
+        @param  Where to store the blended values
+    ==============================*/
+    void interp_get(const float* values, float* out);
+
+    /*==============================
+        interp_get_float
+        Gets a single registered value blended between the
+        last two ticks by the current subtick
+        @param  The value that was registered
+        @return The blended value
+    ==============================*/
+    float interp_get_float(const float* value);
+
+
+    /***************************************************************
+                      Internal Interpolation
+                  Do not use anything below this line
+    ***************************************************************/
+
+    void interp_tick();
+    void interp_reset();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,221 @@
+/***************************************************************
+                           iosched.c
+
+A filesystem that reads files from the ROM in bounded chunks,
+refilling the audio between them so that bulk loads never hold
+the cartridge bus long enough to starve the music.
+***************************************************************/
+
+#include <libdragon.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "core.h"
+#include "iosched.h"
+
+
+/*********************************
+             Structs
+*********************************/
+
+typedef struct {
+    int fd;
+} IoSchedFile;
+
+
+/*********************************
+             Globals
+*********************************/
+
+// The frame being counted and the last one that was finished
+static IoSchedStats global_iosched_stats[2];
+static int global_iosched_current = 0;
+
+// The audio gaps are only counted while a file is open
+static int global_iosched_openfiles = 0;
+static uint32_t global_iosched_lastpump = 0;
+
+
+/*==============================
+    iosched_addgap
+    Counts the time since the audio was last refilled,
+    if it is the longest this frame
+==============================*/
+
+static void iosched_addgap()
+{
+    IoSchedStats* stats = &global_iosched_stats[global_iosched_current];
+    uint32_t gap = TICKS_TO_US(TICKS_DISTANCE(global_iosched_lastpump, get_ticks()));
+    if (gap > stats->worstgapus)
+        stats->worstgapus = gap;
+}
+
+
+/*==============================
+    iosched_open
+    Opens the same path on the ROM, refilling the audio
+    first so the gaps are counted from the open
+==============================*/
+
+static void* iosched_open(char* name, int flags)
+{
+    IoSchedFile* file;
+    int fd;
+    char path[strlen(name) + 6];
+
+    core_audio_pump();
+    while (name[0] == '/')
+        name++;
+    sprintf(path, "rom:/%s", name);
+    fd = open(path, flags);
+    if (fd < 0)
+        return NULL;
+
+    file = malloc(sizeof(IoSchedFile));
+    file->fd = fd;
+    global_iosched_openfiles++;
+    return file;
+}
+
+
+/*==============================
+    iosched_fstat
+    Gets the information of an open file
+==============================*/
+
+static int iosched_fstat(void* file, struct stat* st)
+{
+    return fstat(((IoSchedFile*)file)->fd, st);
+}
+
+
+/*==============================
+    iosched_lseek
+    Moves the position in an open file
+==============================*/
+
+static int iosched_lseek(void* file, int offset, int whence)
+{
+    return lseek(((IoSchedFile*)file)->fd, offset, whence);
+}
+
+
+/*==============================
+    iosched_read
+    Reads from an open file one chunk at a time, letting the
+    audio refill its buffers before and after each chunk.
+    Anything done with the data in between, like
+    decompressing it, delays the next refill, and shows up
+    in worstgapus.
+==============================*/
+
+static int iosched_read(void* file, uint8_t* ptr, int len)
+{
+    IoSchedStats* stats = &global_iosched_stats[global_iosched_current];
+    int fd = ((IoSchedFile*)file)->fd;
+    uint32_t queue = (len + IOSCHED_CHUNK - 1)/IOSCHED_CHUNK;
+    int done = 0;
+
+    if (queue > stats->maxqueue)
+        stats->maxqueue = queue;
+    while (done < len)
+    {
+        int size = len - done < IOSCHED_CHUNK ? len - done : IOSCHED_CHUNK;
+        int result;
+
+        core_audio_pump();
+        result = read(fd, ptr + done, size);
+        if (result <= 0)
+        {
+            if (done == 0)
+                done = result;
+            break;
+        }
+
+        stats->bytes += result;
+        stats->chunks++;
+        done += result;
+    }
+    core_audio_pump();
+    return done;
+}
+
+
+/*==============================
+    iosched_close
+    Closes an open file
+==============================*/
+
+static int iosched_close(void* file)
+{
+    int result = close(((IoSchedFile*)file)->fd);
+    iosched_addgap();
+    global_iosched_openfiles--;
+    free(file);
+    return result;
+}
+
+
+/*********************************
+           Filesystem
+*********************************/
+
+static filesystem_t global_iosched_fs = {
+    .open = iosched_open,
+    .fstat = iosched_fstat,
+    .lseek = iosched_lseek,
+    .read = iosched_read,
+    .close = iosched_close,
+};
+
+
+/*==============================
+    iosched_init
+    Registers the load:/ filesystem
+==============================*/
+
+void iosched_init()
+{
+    attach_filesystem(IOSCHED_PREFIX, &global_iosched_fs);
+}
+
+
+/*==============================
+    iosched_get_stats
+    Gets what the loads of the last frame cost
+    @return The stats of the last finished frame
+==============================*/
+
+const IoSchedStats* iosched_get_stats()
+{
+    return &global_iosched_stats[!global_iosched_current];
+}
+
+
+/*==============================
+    iosched_endframe
+    Makes the frame being counted the last finished one.
+    Called by the core after every loop of the minigame.
+==============================*/
+
+void iosched_endframe()
+{
+    global_iosched_current = !global_iosched_current;
+    memset(&global_iosched_stats[global_iosched_current], 0, sizeof(IoSchedStats));
+}
+
+
+/*==============================
+    iosched_audiopumped
+    Counts the time since the last refill if a file is
+    open. Called by the core every time it refills the
+    audio.
+==============================*/
+
+void iosched_audiopumped()
+{
+    if (global_iosched_openfiles > 0)
+        iosched_addgap();
+    global_iosched_lastpump = get_ticks();
+}
@@ -0,0 +1,65 @@
+#ifndef GAMEJAM2024_IOSCHED_H
+#define GAMEJAM2024_IOSCHED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+    /***************************************************************
+                      Public I/O Scheduler Constants
+    ***************************************************************/
+
+    // Files opened with this prefix instead of rom:/ are read in chunks
+    #define IOSCHED_PREFIX  "load:/"
+
+    // The most bytes read from the cartridge before the audio gets its turn again
+    #define IOSCHED_CHUNK   (16*1024)
+
+    // What the loads of a single frame cost
+    typedef struct {
+        uint32_t bytes;         // How many bytes were loaded
+        uint32_t chunks;        // How many chunks they were read in
+        uint32_t maxqueue;      // The most chunks a single read was waiting on
+        uint32_t worstgapus;    // The longest time between two audio refills while a load:/ file was open, in microseconds
+    } IoSchedStats;
+
+
+    /***************************************************************
+                      Public I/O Scheduler Functions
+    ***************************************************************/
+
+    /*
+        Loading something big while music plays, for instance
+        t3d_model_load("load:/mygame/level.t3dm"), reads the file through
+        the scheduler instead of in one go. Between every IOSCHED_CHUNK
+        bytes the audio buffers are refilled, so streamed music and sounds
+        always come before bulk loads on the cartridge bus. Decompressing
+        what was read can't be split, so compressed assets can still
+        hold the audio up after their last chunk. Anything that
+        opens files with fopen or open can take a load:/ path. Keep using
+        rom:/ for wav64 and xm64 files, which the mixer streams itself.
+    */
+
+    /*==============================
+        iosched_get_stats
+        Gets what the loads of the last frame cost
+        @return The stats of the last finished frame
+    ==============================*/
+    const IoSchedStats* iosched_get_stats();
+
+
+    /***************************************************************
+                       Internal I/O Scheduler
+                  Do not use anything below this line
+    ***************************************************************/
+
+    void iosched_init();
+    void iosched_endframe();
+    void iosched_audiopumped();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,163 @@
+/***************************************************************
+                         latencyprobe.c
+
+Times button presses from the moment the controllers are read
+to the vertical blank that shows their result on screen.
+***************************************************************/
+
+#include <libdragon.h>
+#include <string.h>
+#include "latencyprobe.h"
+
+
+/*********************************
+             Structs
+*********************************/
+
+typedef enum {
+    PROBE_IDLE = 0,
+    PROBE_WAITFRAME,
+    PROBE_WAITRENDER,
+    PROBE_WAITPRESENT,
+} ProbeState;
+
+
+/*********************************
+             Globals
+*********************************/
+
+static volatile ProbeState global_latencyprobe_state = PROBE_IDLE;
+static uint32_t global_latencyprobe_start;
+static LatencyStats global_latencyprobe_stats;
+
+
+/*==============================
+    latencyprobe_input
+    Starts timing if a button was just pressed on any
+    controller. Called by the core right after reading the
+    controllers.
+==============================*/
+
+void latencyprobe_input()
+{
+    if (global_latencyprobe_state != PROBE_IDLE)
+        return;
+    JOYPAD_PORT_FOREACH(port)
+    {
+        if (joypad_get_buttons_pressed(port).raw != 0)
+        {
+            global_latencyprobe_start = get_ticks();
+            global_latencyprobe_state = PROBE_WAITFRAME;
+            return;
+        }
+    }
+}
+
+
+/*==============================
+    latencyprobe_rendered
+    Called once the RDP has finished drawing the frame
+    after the press, which was handed to the display
+    before this
+    @param  Unused
+==============================*/
+
+static void latencyprobe_rendered(void* arg)
+{
+    if (global_latencyprobe_state == PROBE_WAITRENDER)
+        global_latencyprobe_state = PROBE_WAITPRESENT;
+}
+
+
+/*==============================
+    latencyprobe_endframe
+    Marks the end of the first frame drawn after the press.
+    Called by the core after every loop of the minigame
+    that drew something.
+==============================*/
+
+void latencyprobe_endframe()
+{
+    if (global_latencyprobe_state != PROBE_WAITFRAME)
+        return;
+    global_latencyprobe_state = PROBE_WAITRENDER;
+    rdpq_sync_full(latencyprobe_rendered, NULL);
+}
+
+
+/*==============================
+    latencyprobe_skipframe
+    Forgets a press whose frame wasn't drawn, as nothing
+    new reaches the screen while the minigame is paused.
+    Called by the core after every loop of the minigame
+    that didn't draw anything.
+==============================*/
+
+void latencyprobe_skipframe()
+{
+    if (global_latencyprobe_state == PROBE_WAITFRAME)
+        global_latencyprobe_state = PROBE_IDLE;
+}
+
+
+/*==============================
+    latencyprobe_vblank
+    Stops timing once the marked frame has been drawn,
+    as the display swaps to it on this vertical blank.
+    Called by the core's vertical blank interrupt.
+==============================*/
+
+void latencyprobe_vblank()
+{
+    uint32_t elapsed;
+    if (global_latencyprobe_state != PROBE_WAITPRESENT)
+        return;
+
+    elapsed = TICKS_TO_US(TICKS_DISTANCE(global_latencyprobe_start, get_ticks()));
+    if (global_latencyprobe_stats.samples == 0 || elapsed < global_latencyprobe_stats.minus)
+        global_latencyprobe_stats.minus = elapsed;
+    if (elapsed > global_latencyprobe_stats.maxus)
+        global_latencyprobe_stats.maxus = elapsed;
+    global_latencyprobe_stats.totalus += elapsed;
+    global_latencyprobe_stats.samples++;
+    global_latencyprobe_state = PROBE_IDLE;
+}
+
+
+/*==============================
+    latencyprobe_get_stats
+    Gets the latencies measured since the minigame
+    started
+    @return The latency stats
+==============================*/
+
+const LatencyStats* latencyprobe_get_stats()
+{
+    return &global_latencyprobe_stats;
+}
+
+
+/*==============================
+    latencyprobe_report
+    Logs the latencies measured and starts over. Called
+    by the core when a minigame ends.
+    @param  The name of the minigame
+==============================*/
+
+void latencyprobe_report(const char* name)
+{
+    LatencyStats stats;
+    disable_interrupts();
+    stats = global_latencyprobe_stats;
+    memset(&global_latencyprobe_stats, 0, sizeof(LatencyStats));
+    global_latencyprobe_state = PROBE_IDLE;
+    enable_interrupts();
+
+    if (stats.samples == 0)
+    {
+        debugf("Input to present latency in %s: no presses measured\n", name);
+        return;
+    }
+    debugf("Input to present latency in %s: %lu presses, avg %.1f ms, min %.1f ms, max %.1f ms\n", name,
+        stats.samples, (stats.totalus/stats.samples)/1000.0f, stats.minus/1000.0f, stats.maxus/1000.0f);
+}
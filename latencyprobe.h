@@ -0,0 +1,62 @@
+#ifndef GAMEJAM2024_LATENCYPROBE_H
+#define GAMEJAM2024_LATENCYPROBE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+    /***************************************************************
+                    Public Latency Probe Constants
+    ***************************************************************/
+
+    // The input to present latencies measured since the minigame started
+    typedef struct {
+        uint32_t samples;   // How many button presses were measured
+        uint64_t totalus;   // All the latencies added up, in microseconds
+        uint32_t minus;     // The shortest latency, in microseconds
+        uint32_t maxus;     // The longest latency, in microseconds
+    } LatencyStats;
+
+
+    /***************************************************************
+                    Public Latency Probe Functions
+    ***************************************************************/
+
+    /*
+        When LATENCY_PROBE is enabled in config.h, the core times how
+        long each button press takes to reach the screen. The clock
+        starts when the controllers are read and a button was pressed
+        on any of them, and stops at the vertical blank that shows the
+        first frame drawn after that read, whose ticks have seen it. A
+        press made between two reads isn't seen until the second one,
+        so the real latency can be up to one frame longer. Presses made
+        while nothing is drawn, like when the minigame is paused, aren't
+        counted. The results are logged when the minigame ends.
+    */
+
+    /*==============================
+        latencyprobe_get_stats
+        Gets the latencies measured since the minigame
+        started
+        @return The latency stats
+    ==============================*/
+    const LatencyStats* latencyprobe_get_stats();
+
+
+    /***************************************************************
+                      Internal Latency Probe
+                  Do not use anything below this line
+    ***************************************************************/
+
+    void latencyprobe_input();
+    void latencyprobe_endframe();
+    void latencyprobe_skipframe();
+    void latencyprobe_vblank();
+    void latencyprobe_report(const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -12,6 +12,56 @@ and provides a basic game loop.
 #include "menu.h"
 #include "config.h"
 #include "minigame.h"
+#include "assetcache.h"
+#include "textcache.h"
+#include "renderstats.h"
+#include "sfxbank.h"
+#include "audiobench.h"
+#include "iosched.h"
+#include "interp.h"
+#include "latencyprobe.h"
+
+
+/*********************************
+             Globals
+*********************************/
+
+static volatile uint32_t global_main_vicount = 0;
+
+
+/*==============================
+    vi_handler
+    Called every vertical blank
+==============================*/
+
+static void vi_handler()
+{
+    // Call rand() every frame so to get random behavior also in emulators
+    rand();
+    global_main_vicount++;
+    #if LATENCY_PROBE
+        latencyprobe_vblank();
+    #endif
+}
+
+
+/*==============================
+    main_get_viperframe
+    Gets how many vertical blanks each frame is shown for
+    to present at TARGET_FPS
+    @return The number of vertical blanks per frame, or 0
+            if the frame rate isn't locked
+==============================*/
+
+static uint32_t main_get_viperframe()
+{
+    uint32_t virate = (get_tv_type() == TV_PAL) ? 50 : 60;
+    uint32_t viperframe;
+    if (TARGET_FPS <= 0)
+        return 0;
+    viperframe = (virate + TARGET_FPS/2)/TARGET_FPS;
+    return viperframe > 0 ? viperframe : 1;
+}
 
 
 /*==============================
@@ -30,14 +80,14 @@ int main()
     asset_init_compression(2);
     asset_init_compression(3);
     dfs_init(DFS_DEFAULT_LOCATION);
+    iosched_init();
     debug_init_usblog();
     debug_init_isviewer();
     joypad_init();
     timer_init();
     rdpq_init();
     minigame_loadall();
-    audio_init(32000, 3);
-    mixer_init(32);
+    core_set_audio(0, 0, 0, 0);
 
     // Enable RDP debugging
     #if DEBUG_RDP
@@ -46,63 +96,141 @@ int main()
         rspq_profile_start();
     #endif
 
-    // Initialize the random number generator, then call rand() every
-    // frame so to get random behavior also in emulators.
+    // Initialize the random number generator
     uint32_t seed;
     getentropy(&seed, sizeof(seed));
     srand(seed);
-    register_VI_handler((void(*)(void))rand);
+    register_VI_handler(vi_handler);
+
+    // Measure the audio files before anything else plays
+    #if AUDIO_BENCHMARK
+        audiobench_run();
+    #endif
 
     // Program Loop
     while (1)
     {
         char* game;
-        float accumulator = 0;
-        const float dt = DELTATIME;
+        uint64_t accumulator = 0;
+        const uint32_t ticklength = TICKS_PER_SECOND/TICKRATE;
+        const uint32_t viperframe = main_get_viperframe();
+        uint32_t lastticks;
+        uint32_t lastvicount;
 
         // Show the menu
         game = menu();
+        textcache_flush();
         
         // Set the initial minigame
         minigame_play(game);
+        core_set_audio(minigame_get_game()->audio.frequency, minigame_get_game()->audio.buffers,
+                       minigame_get_game()->audio.channels, minigame_get_game()->audio.maxfrequency);
 
         // Initialize the minigame
         core_reset_winners();
+        core_reset_framestats();
         minigame_get_game()->funcPointer_init();
+        lastticks = get_ticks();
+        lastvicount = global_main_vicount;
         
         // Handle the engine loop
         while (!minigame_get_ended())
         {
-            float frametime = display_get_delta_time();
+            float frametime;
+            uint32_t ticks;
+            uint32_t elapsed;
+            uint32_t vicount;
+            uint32_t tickcount;
+
+            if (core_get_staticframe())
+            {
+                // Nothing new is being shown, so pace the loop on the vertical blank instead
+                vicount = global_main_vicount;
+                while (vicount == global_main_vicount)
+                    core_audio_pump();
+            }
+            else if (viperframe > 0)
+            {
+                // Start each frame a fixed number of vertical blanks after the last one, so they are shown evenly
+                vicount = lastvicount + viperframe;
+                while ((int32_t)(global_main_vicount - vicount) < 0)
+                    core_audio_pump();
+                if (global_main_vicount != vicount)
+                    core_add_missedvsyncs(global_main_vicount - vicount);
+            }
+            lastvicount = global_main_vicount;
+
+            ticks = get_ticks();
+            elapsed = TICKS_DISTANCE(lastticks, ticks);
+            lastticks = ticks;
             
-            // In order to prevent problems if the game slows down significantly, we will clamp the maximum timestep the simulation can take
+            // In order to prevent problems if the game slows down significantly, we will clamp the maximum timestep the unfixed loop can take
+            frametime = (float)elapsed/(float)TICKS_PER_SECOND;
             if (frametime > 0.25f)
                 frametime = 0.25f;
+
+            // Read controler data right before simulating, so every tick of this frame sees the newest inputs
+            joypad_poll();
+            #if LATENCY_PROBE
+                latencyprobe_input();
+            #endif
             
-            // Perform the update in discrete steps (ticks)
+            // Perform the update in discrete steps (ticks), dropping the ones that are too far behind to catch up with
             if (minigame_get_game()->funcPointer_fixedloop) {
-                accumulator += frametime;
-                while (accumulator >= dt)
+                accumulator += elapsed;
+                tickcount = accumulator/ticklength;
+                if (tickcount > MAX_CATCHUP_TICKS)
+                {
+                    core_add_droppedticks(tickcount - MAX_CATCHUP_TICKS);
+                    accumulator -= (uint64_t)(tickcount - MAX_CATCHUP_TICKS)*ticklength;
+                    tickcount = MAX_CATCHUP_TICKS;
+                }
+                for (uint32_t i=0; i<tickcount; i++)
                 {
-                    minigame_get_game()->funcPointer_fixedloop(dt);
-                    accumulator -= dt;
+                    core_audio_pump();
+                    minigame_get_game()->funcPointer_fixedloop(DELTATIME);
+                    interp_tick();
+                    accumulator -= ticklength;
                 }
             }
 
-            // Read controler data
-            joypad_poll();
-            mixer_try_play();
+            core_audio_pump();
             
             // Perform the unfixed loop
-            core_set_subtick(((double)accumulator)/((double)dt));
+            core_set_subtick(((double)accumulator)/((double)ticklength));
             minigame_get_game()->funcPointer_loop(frametime);
+            core_audio_pump();
+            if (!core_get_staticframe())
+            {
+                renderstats_endframe();
+                iosched_endframe();
+                #if LATENCY_PROBE
+                    latencyprobe_endframe();
+                #endif
+            }
+            else
+            {
+                #if LATENCY_PROBE
+                    latencyprobe_skipframe();
+                #endif
+            }
         }
         
         // End the current level
+        debugf("Missed vertical blanks: %lu, dropped ticks: %lu\n", core_get_missedvsyncs(), core_get_droppedticks());
+        #if LATENCY_PROBE
+            latencyprobe_report(minigame_get_game()->definition.gamename);
+        #endif
         rspq_wait();
-        for (int i=0; i<32; i++)
+        sfxbank_stopall();
+        for (int i=0; i<core_get_audio_channels(); i++)
             mixer_ch_stop(i);
         minigame_get_game()->funcPointer_cleanup();
+        core_set_staticframe(false);
+        assetcache_flush();
+        textcache_flush();
+        renderstats_reset();
+        interp_reset();
         minigame_cleanup();
     }
 }
\ No newline at end of file
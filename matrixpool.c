@@ -0,0 +1,124 @@
+/***************************************************************
+                          matrixpool.c
+
+Hands out fixed point matrices from one uncached allocation,
+optionally with a copy per frame that is written through the
+cache and flushed in bulk.
+***************************************************************/
+
+#include <libdragon.h>
+#include <string.h>
+#include "matrixpool.h"
+
+
+/*==============================
+    matrixpool_init
+    Allocates the memory for all the matrices of a pool at once.
+    With more than one buffer, each matrix has a copy per frame
+    so the CPU can fill in the next frame while the RSP reads
+    the previous one.
+    @param  The pool to initialize
+    @param  The maximum number of matrices
+    @param  The number of frames buffered, from 1 to
+            MATRIXPOOL_MAX_BUFFERS
+==============================*/
+
+void matrixpool_init(MatrixPool* pool, int capacity, int buffercount)
+{
+    int masksize = (capacity + 31)/32;
+    assertf(capacity > 0, "Matrix pool must hold at least one matrix");
+    assertf(buffercount >= 1 && buffercount <= MATRIXPOOL_MAX_BUFFERS, "Invalid matrix pool buffer count %d", buffercount);
+
+    pool->slots = malloc_uncached(sizeof(T3DMat4FP)*capacity*buffercount);
+    pool->usedmask = calloc(masksize, sizeof(uint32_t));
+    pool->capacity = capacity;
+    pool->buffercount = buffercount;
+    pool->current = 0;
+}
+
+
+/*==============================
+    matrixpool_free
+    Frees the memory of a pool and every matrix in it
+    @param  The pool to free
+==============================*/
+
+void matrixpool_free(MatrixPool* pool)
+{
+    free_uncached(pool->slots);
+    free(pool->usedmask);
+    pool->slots = NULL;
+    pool->usedmask = NULL;
+    pool->capacity = 0;
+}
+
+
+/*==============================
+    matrixpool_alloc
+    Takes a free matrix from the pool. In a single buffered
+    pool the returned address never changes, so it can be
+    recorded in blocks and written to directly.
+    @param  The pool to allocate from
+    @return The uncached matrix, in the first buffer
+==============================*/
+
+T3DMat4FP* matrixpool_alloc(MatrixPool* pool)
+{
+    for (int i=0; i<pool->capacity; i++)
+    {
+        uint32_t bit = 1u << (i%32);
+        if (pool->usedmask[i/32] & bit)
+            continue;
+        pool->usedmask[i/32] |= bit;
+        return &pool->slots[i];
+    }
+    assertf(false, "Matrix pool is full (%d matrices)", pool->capacity);
+    return NULL;
+}
+
+
+/*==============================
+    matrixpool_release
+    Returns a matrix to the pool
+    @param  The pool the matrix came from
+    @param  The matrix returned by matrixpool_alloc
+==============================*/
+
+void matrixpool_release(MatrixPool* pool, T3DMat4FP* mat)
+{
+    int index = mat - pool->slots;
+    assertf(index >= 0 && index < pool->capacity, "Matrix %p is not from this pool", mat);
+    pool->usedmask[index/32] &= ~(1u << (index%32));
+}
+
+
+/*==============================
+    matrixpool_get
+    Gets the copy of a matrix in the frame being built, through
+    the cache. Writes only reach the RSP after matrixpool_flush.
+    @param  The pool the matrix came from
+    @param  The matrix returned by matrixpool_alloc
+    @return The cached copy for the current frame
+==============================*/
+
+T3DMat4FP* matrixpool_get(MatrixPool* pool, const T3DMat4FP* mat)
+{
+    int index = mat - pool->slots;
+    assertf(index >= 0 && index < pool->capacity, "Matrix %p is not from this pool", mat);
+    return CachedAddr(&pool->slots[pool->current*pool->capacity + index]);
+}
+
+
+/*==============================
+    matrixpool_flush
+    Writes back every matrix of the frame being built in one go,
+    then moves on to the next buffer. Call this after writing
+    the matrices and before drawing anything that uses them.
+    @param  The pool to flush
+==============================*/
+
+void matrixpool_flush(MatrixPool* pool)
+{
+    data_cache_hit_writeback(CachedAddr(&pool->slots[pool->current*pool->capacity]), sizeof(T3DMat4FP)*pool->capacity);
+    pool->current = (pool->current + 1)%pool->buffercount;
+}
@@ -0,0 +1,92 @@
+#ifndef GAMEJAM2024_MATRIXPOOL_H
+#define GAMEJAM2024_MATRIXPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    #include <t3d/t3d.h>
+
+
+    /***************************************************************
+                      Public Matrix Pool Constants
+    ***************************************************************/
+
+    #define MATRIXPOOL_MAX_BUFFERS  3
+
+    // A set of fixed point matrices sharing one uncached allocation
+    typedef struct {
+        T3DMat4FP* slots;
+        uint32_t* usedmask;
+        int capacity;
+        int buffercount;
+        int current;
+    } MatrixPool;
+
+
+    /***************************************************************
+                      Public Matrix Pool Functions
+    ***************************************************************/
+
+    /*==============================
+        matrixpool_init
+        Allocates the memory for all the matrices of a pool at once.
+        With more than one buffer, each matrix has a copy per frame
+        so the CPU can fill in the next frame while the RSP reads
+        the previous one.
+        @param  The pool to initialize
+        @param  The maximum number of matrices
+        @param  The number of frames buffered, from 1 to
+                MATRIXPOOL_MAX_BUFFERS
+    ==============================*/
+    void matrixpool_init(MatrixPool* pool, int capacity, int buffercount);
+
+    /*==============================
+        matrixpool_free
+        Frees the memory of a pool and every matrix in it
+        @param  The pool to free
+    ==============================*/
+    void matrixpool_free(MatrixPool* pool);
+
+    /*==============================
+        matrixpool_alloc
+        Takes a free matrix from the pool. In a single buffered
+        pool the returned address never changes, so it can be
+        recorded in blocks and written to directly.
+        @param  The pool to allocate from
+        @return The uncached matrix, in the first buffer
+    ==============================*/
+    T3DMat4FP* matrixpool_alloc(MatrixPool* pool);
+
+    /*==============================
+        matrixpool_release
+        Returns a matrix to the pool
+        @param  The pool the matrix came from
+        @param  The matrix returned by matrixpool_alloc
+    ==============================*/
+    void matrixpool_release(MatrixPool* pool, T3DMat4FP* mat);
+
+    /*==============================
+        matrixpool_get
+        Gets the copy of a matrix in the frame being built, through
+        the cache. Writes only reach the RSP after matrixpool_flush.
+        @param  The pool the matrix came from
+        @param  The matrix returned by matrixpool_alloc
+        @return The cached copy for the current frame
+    ==============================*/
+    T3DMat4FP* matrixpool_get(MatrixPool* pool, const T3DMat4FP* mat);
+
+    /*==============================
+        matrixpool_flush
+        Writes back every matrix of the frame being built in one go,
+        then moves on to the next buffer. Call this after writing
+        the matrices and before drawing anything that uses them.
+        @param  The pool to flush
+    ==============================*/
+    void matrixpool_flush(MatrixPool* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
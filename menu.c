@@ -9,6 +9,7 @@ This file contains the code for the basic menu
 #include "menu.h"
 #include "core.h"
 #include "config.h"
+#include "textcache.h"
 
 
 /*********************************
@@ -255,8 +256,9 @@ char* menu(void)
         rdpq_attach(disp, NULL);
         rdpq_clear(ASH_GRAY);
 
+        static int16_t tabstops[] = { 15 };
         rdpq_textparms_t textparms = {
-            .width = 200, .tabstops = (int16_t[]){ 15 },
+            .width = 200, .tabstops = tabstops,
         };
 
         rdpq_set_mode_standard();
@@ -285,7 +287,7 @@ char* menu(void)
         rdpq_set_mode_standard();
 
         int ycur = y0;
-        ycur += rdpq_text_print(&textparms, FONT_TEXT, x0-20, ycur, heading).advance_y;
+        ycur += textcache_print(&textparms, FONT_TEXT, x0-20, ycur, heading).advance_y;
         ycur += 4;
 
         for (int i = 0; i < item_count; i++) {
@@ -293,13 +295,13 @@ char* menu(void)
 
             switch (current_screen) {
             case SCREEN_PLAYERCOUNT:
-                ycur += rdpq_text_printf(&textparms, FONT_TEXT, x0, ycur, "%d\n", i+1).advance_y;
+                ycur += textcache_printf(&textparms, FONT_TEXT, x0, ycur, "%d\n", i+1).advance_y;
                 break;
             case SCREEN_AIDIFFICULTY:
-                ycur += rdpq_text_printf(&textparms, FONT_TEXT, x0, ycur, "%s\n", get_difficulty_name(i)).advance_y;
+                ycur += textcache_printf(&textparms, FONT_TEXT, x0, ycur, "%s\n", get_difficulty_name(i)).advance_y;
                 break;
             case SCREEN_MINIGAME:
-                ycur += rdpq_text_printf(&textparms, FONT_TEXT, x0, ycur, "%d.\t%s\n", i+1, global_minigame_list[sorted_indices[i]].definition.gamename).advance_y;
+                ycur += textcache_printf(&textparms, FONT_TEXT, x0, ycur, "%d.\t%s\n", i+1, global_minigame_list[sorted_indices[i]].definition.gamename).advance_y;
                 break;
             }
         }
@@ -313,8 +315,8 @@ char* menu(void)
             Minigame *cur = &global_minigame_list[sorted_indices[select]];
 
             int y0 = 180;
-            y0 += rdpq_text_printf(&parms, FONT_TEXT, 10, y0, "%s\n\n", cur->definition.description).advance_y;
-            y0 += rdpq_text_printf(&parms, FONT_TEXT, 10, y0, "%s\n", cur->definition.instructions).advance_y;
+            y0 += textcache_printf(&parms, FONT_TEXT, 10, y0, "%s\n\n", cur->definition.description).advance_y;
+            y0 += textcache_printf(&parms, FONT_TEXT, 10, y0, "%s\n", cur->definition.instructions).advance_y;
         }
 
         if (true) {
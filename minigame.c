@@ -120,6 +120,13 @@ void minigame_play(char* name)
     global_minigame_current->funcPointer_loop      = dlsym(global_minigame_current->handle, "minigame_loop");
     global_minigame_current->funcPointer_fixedloop = dlsym(global_minigame_current->handle, "minigame_fixedloop");
     global_minigame_current->funcPointer_cleanup   = dlsym(global_minigame_current->handle, "minigame_cleanup");
+
+    // The audio settings are optional
+    MinigameAudio* audio = dlsym(global_minigame_current->handle, "minigame_audio");
+    if (audio != NULL)
+        global_minigame_current->audio = *audio;
+    else
+        memset(&global_minigame_current->audio, 0, sizeof(MinigameAudio));
 }
 
 
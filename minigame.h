@@ -17,6 +17,15 @@ extern "C" {
         const char* instructions;
     } MinigameDef;
 
+    // You can also define one of these globally, named minigame_audio, to change how the audio
+    // is set up while your minigame runs. Anything left at 0 keeps the core's default.
+    typedef struct {
+        int frequency;      // The output sample rate (AUDIO_FREQUENCY)
+        int buffers;        // How many audio buffers are queued (AUDIO_BUFFERS)
+        int channels;       // How many mixer channels there are (AUDIO_CHANNELS)
+        int maxfrequency;   // The highest rate any channel plays samples at, which sizes its buffers
+    } MinigameAudio;
+
 
     /***************************************************************
                        Public Minigame Functions
@@ -39,6 +48,7 @@ extern "C" {
     typedef struct {
         char* internalname;
         MinigameDef definition;
+        MinigameAudio audio;
         void* handle;
         void (*funcPointer_init)(void);
         void (*funcPointer_loop)(float deltatime);
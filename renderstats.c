@@ -0,0 +1,135 @@
+/***************************************************************
+                          renderstats.c
+
+Counts the syncs, mode changes and texture uploads issued by each
+labelled call site, one frame at a time.
+***************************************************************/
+
+#include <libdragon.h>
+#include <string.h>
+#include "renderstats.h"
+
+
+/*********************************
+             Globals
+*********************************/
+
+// The frame being drawn and the last one that was finished
+static RenderStatSite global_renderstats_sites[2][RENDERSTATS_MAXSITES];
+static int global_renderstats_count[2];
+static int global_renderstats_current = 0;
+
+
+/*==============================
+    renderstats_count
+    Adds to one of the counters of a call site in the
+    frame being drawn. Prefer the rstat_ macros, which
+    compile away when RENDER_STATS is disabled.
+    @param  The call site label
+    @param  The counter to add to
+    @param  How much to add
+==============================*/
+
+void renderstats_count(const char* label, RenderStat stat, uint32_t amount)
+{
+    RenderStatSite* sites = global_renderstats_sites[global_renderstats_current];
+    int* count = &global_renderstats_count[global_renderstats_current];
+    int i;
+
+    // Labels are usually string literals, so try the pointer before comparing the text
+    for (i=0; i<*count; i++)
+        if (sites[i].label == label || !strcmp(sites[i].label, label))
+            break;
+    if (i == *count)
+    {
+        if (*count == RENDERSTATS_MAXSITES)
+            return;
+        memset(&sites[i], 0, sizeof(RenderStatSite));
+        sites[i].label = label;
+        (*count)++;
+    }
+    sites[i].counts[stat] += amount;
+}
+
+
+/*==============================
+    renderstats_get_sites
+    Gets the counts of every label from the last frame
+    that was finished. The pointer stays valid until the
+    next frame ends.
+    @param  Where to store the number of labels
+    @return The array of call sites
+==============================*/
+
+const RenderStatSite* renderstats_get_sites(int* count)
+{
+    int last = !global_renderstats_current;
+    *count = global_renderstats_count[last];
+    return global_renderstats_sites[last];
+}
+
+
+/*==============================
+    renderstats_get_total
+    Gets the sum of a counter over every label of the
+    last frame that was finished
+    @param  The counter to sum
+    @return The total
+==============================*/
+
+uint32_t renderstats_get_total(RenderStat stat)
+{
+    int count;
+    uint32_t total = 0;
+    const RenderStatSite* sites = renderstats_get_sites(&count);
+    for (int i=0; i<count; i++)
+        total += sites[i].counts[stat];
+    return total;
+}
+
+
+/*==============================
+    renderstats_print
+    Prints the counts of the last finished frame to the
+    debug log, one line per label
+==============================*/
+
+void renderstats_print()
+{
+    int count;
+    const RenderStatSite* sites = renderstats_get_sites(&count);
+    debugf("Render stats: %d sites (pipe/tile/load syncs, mode pushes, mode sets, uploads)\n", count);
+    for (int i=0; i<count; i++)
+    {
+        const uint32_t* c = sites[i].counts;
+        debugf("  %-24s %4lu %4lu %4lu %4lu %4lu %4lu\n", sites[i].label,
+            c[RSTAT_SYNC_PIPE], c[RSTAT_SYNC_TILE], c[RSTAT_SYNC_LOAD], c[RSTAT_MODE_PUSH], c[RSTAT_MODE_SET], c[RSTAT_TEX_UPLOAD]);
+    }
+}
+
+
+/*==============================
+    renderstats_endframe
+    Makes the frame being drawn the last finished one and
+    starts counting a new one. Called by the core after
+    every loop of the minigame.
+==============================*/
+
+void renderstats_endframe()
+{
+    global_renderstats_current = !global_renderstats_current;
+    global_renderstats_count[global_renderstats_current] = 0;
+}
+
+
+/*==============================
+    renderstats_reset
+    Forgets every count, so that labels from a minigame
+    that was unloaded aren't read after it is gone
+==============================*/
+
+void renderstats_reset()
+{
+    global_renderstats_count[0] = 0;
+    global_renderstats_count[1] = 0;
+}
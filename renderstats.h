@@ -0,0 +1,128 @@
+#ifndef GAMEJAM2024_RENDERSTATS_H
+#define GAMEJAM2024_RENDERSTATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    #include <stdint.h>
+    #include "config.h"
+
+
+    /***************************************************************
+                     Public Render Stats Constants
+    ***************************************************************/
+
+    // How many different labels can be counted in a single frame
+    #define RENDERSTATS_MAXSITES  32
+
+    // The kinds of RDP work that get counted
+    typedef enum {
+        RSTAT_SYNC_PIPE = 0,
+        RSTAT_SYNC_TILE,
+        RSTAT_SYNC_LOAD,
+        RSTAT_MODE_PUSH,
+        RSTAT_MODE_SET,
+        RSTAT_TEX_UPLOAD,
+        RSTAT_COUNT,
+    } RenderStat;
+
+    // The counts of a single call site label in a frame
+    typedef struct {
+        const char* label;
+        uint32_t counts[RSTAT_COUNT];
+    } RenderStatSite;
+
+
+    /***************************************************************
+                    Public Render Stats Macros
+    ***************************************************************/
+
+    /*
+        Use these in place of the rdpq calls you want counted. The label
+        identifies the call site, so give every site you care about its
+        own string. When RENDER_STATS is disabled in config.h they become
+        the plain rdpq calls and cost nothing.
+        Only the calls made through these are counted. Syncs that rdpq
+        inserts by itself, and the modes and textures that T3D materials
+        and TPX set up, are invisible. A blit counts as one upload, even
+        when it is split into several TMEM loads. Calls recorded in a
+        block are counted when recorded, so count the ones in a block
+        with rstat_add where it is run instead.
+    */
+
+    #if RENDER_STATS
+        #define rstat_add(label, stat, amount)  renderstats_count(label, stat, amount)
+    #else
+        #define rstat_add(label, stat, amount)  ((void)0)
+    #endif
+    #define rstat_count(label, stat)  rstat_add(label, stat, 1)
+
+    #define rstat_sync_pipe(label)  do { rstat_count(label, RSTAT_SYNC_PIPE); rdpq_sync_pipe(); } while (0)
+    #define rstat_sync_tile(label)  do { rstat_count(label, RSTAT_SYNC_TILE); rdpq_sync_tile(); } while (0)
+    #define rstat_sync_load(label)  do { rstat_count(label, RSTAT_SYNC_LOAD); rdpq_sync_load(); } while (0)
+    #define rstat_mode_push(label)  do { rstat_count(label, RSTAT_MODE_PUSH); rdpq_mode_push(); } while (0)
+    #define rstat_set_mode_standard(label)  do { rstat_count(label, RSTAT_MODE_SET); rdpq_set_mode_standard(); } while (0)
+    #define rstat_set_mode_copy(label, transparency)  do { rstat_count(label, RSTAT_MODE_SET); rdpq_set_mode_copy(transparency); } while (0)
+    #define rstat_set_mode_fill(label, color)  do { rstat_count(label, RSTAT_MODE_SET); rdpq_set_mode_fill(color); } while (0)
+    #define rstat_tex_upload_sub(label, tile, tex, parms, s0, t0, s1, t1)  do { rstat_count(label, RSTAT_TEX_UPLOAD); rdpq_tex_upload_sub(tile, tex, parms, s0, t0, s1, t1); } while (0)
+    #define rstat_sprite_upload(label, tile, sprite, parms)  do { rstat_count(label, RSTAT_TEX_UPLOAD); rdpq_sprite_upload(tile, sprite, parms); } while (0)
+    #define rstat_tex_blit(label, tex, x, y, parms)  do { rstat_count(label, RSTAT_TEX_UPLOAD); rdpq_tex_blit(tex, x, y, parms); } while (0)
+    #define rstat_sprite_blit(label, sprite, x, y, parms)  do { rstat_count(label, RSTAT_TEX_UPLOAD); rdpq_sprite_blit(sprite, x, y, parms); } while (0)
+
+
+    /***************************************************************
+                    Public Render Stats Functions
+    ***************************************************************/
+
+    /*==============================
+        renderstats_count
+        Adds to one of the counters of a call site in the
+        frame being drawn. Prefer the rstat_ macros, which
+        compile away when RENDER_STATS is disabled.
+        @param  The call site label
+        @param  The counter to add to
+        @param  How much to add
+    ==============================*/
+    void renderstats_count(const char* label, RenderStat stat, uint32_t amount);
+
+    /*==============================
+        renderstats_get_sites
+        Gets the counts of every label from the last frame
+        that was finished. The pointer stays valid until the
+        next frame ends.
+        @param  Where to store the number of labels
+        @return The array of call sites
+    ==============================*/
+    const RenderStatSite* renderstats_get_sites(int* count);
+
+    /*==============================
+        renderstats_get_total
+        Gets the sum of a counter over every label of the
+        last frame that was finished
+        @param  The counter to sum
+        @return The total
+    ==============================*/
+    uint32_t renderstats_get_total(RenderStat stat);
+
+    /*==============================
+        renderstats_print
+        Prints the counts of the last finished frame to the
+        debug log, one line per label
+    ==============================*/
+    void renderstats_print();
+
+
+    /***************************************************************
+                        Internal Render Stats
+                  Do not use anything below this line
+    ***************************************************************/
+
+    void renderstats_endframe();
+    void renderstats_reset();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,225 @@
+/***************************************************************
+                           sfxbank.c
+
+Keeps short sound effects decoded in RAM and plays them through
+a small pool of mixer channels, stealing the least important
+voice when they are all busy.
+***************************************************************/
+
+#include <libdragon.h>
+#include <string.h>
+#include "core.h"
+#include "sfxbank.h"
+
+
+/*********************************
+             Structs
+*********************************/
+
+typedef struct {
+    const void* owner;
+    int priority;
+    uint32_t started;
+} SfxVoice;
+
+
+/*********************************
+             Globals
+*********************************/
+
+static SfxVoice global_sfxbank_voices[SFXBANK_VOICES];
+static uint32_t global_sfxbank_playcount = 0;
+
+
+/*==============================
+    sfxbank_get_voicecount
+    Gets how many voices fit in the mixer channels the
+    current minigame asked for
+    @return The number of voices
+==============================*/
+
+static int sfxbank_get_voicecount()
+{
+    int count = core_get_audio_channels() - SFXBANK_FIRST_CHANNEL;
+    if (count < 0)
+        return 0;
+    return count < SFXBANK_VOICES ? count : SFXBANK_VOICES;
+}
+
+
+/*==============================
+    sfxbank_read
+    The mixer's read callback, which copies the requested
+    samples straight out of RAM
+==============================*/
+
+static void sfxbank_read(void* ctx, samplebuffer_t* sbuf, int wpos, int wlen, bool seeking)
+{
+    const SfxSample* sample = (const SfxSample*)ctx;
+    uint8_t* dest = (uint8_t*)samplebuffer_append(sbuf, wlen);
+    memcpy(dest, sample->data + (wpos << sample->shift), wlen << sample->shift);
+}
+
+
+/*==============================
+    sfxbank_load
+    Reads a whole wav64 into RAM, decoding it once if it is
+    compressed, so that playing it never goes back to the
+    ROM or the decoder
+    @param  The sample to load into
+    @param  The path to the wav64 file
+==============================*/
+
+void sfxbank_load(SfxSample* sample, const char* path)
+{
+    wav64_t wav;
+    samplebuffer_t sbuf;
+    int size;
+
+    // Let the wav64 reader decode it, with a sample buffer large enough for the whole file.
+    // Compressed formats decode whole frames, so leave room for the last one to overrun.
+    wav64_open(&wav, path);
+    sample->shift = (wav.wave.bits == 16) + (wav.wave.channels == 2);
+    size = (wav.wave.len + wav.wave.frequency/50 + 64) << sample->shift;
+    sample->data = malloc_uncached(size);
+    samplebuffer_init(&sbuf, sample->data, size);
+    samplebuffer_set_bps(&sbuf, wav.wave.bits*wav.wave.channels);
+    wav.wave.read(wav.wave.ctx, &sbuf, 0, wav.wave.len, true);
+
+    // VADPCM and Opus are decoded on the RSP, so wait for it to finish writing
+    rspq_wait();
+    samplebuffer_close(&sbuf);
+
+    sample->wave = (waveform_t){
+        .name = wav.wave.name,
+        .bits = wav.wave.bits,
+        .channels = wav.wave.channels,
+        .frequency = wav.wave.frequency,
+        .len = wav.wave.len,
+        .loop_len = 0,
+        .read = sfxbank_read,
+        .ctx = sample,
+    };
+    wav64_close(&wav);
+}
+
+
+/*==============================
+    sfxbank_free
+    Stops every voice playing a sample and frees it
+    @param  The sample to free
+==============================*/
+
+void sfxbank_free(SfxSample* sample)
+{
+    for (int i=0; i<sfxbank_get_voicecount(); i++)
+        if (global_sfxbank_voices[i].owner == sample)
+            sfxbank_stop(i);
+    free_uncached(sample->data);
+    sample->data = NULL;
+}
+
+
+/*==============================
+    sfxbank_take_voice
+    Takes a free voice. If every voice is busy, the one with
+    the lowest priority is stolen, picking the oldest among
+    equals, but only if its priority isn't higher than the
+    new sound's.
+    @param  What will play on the voice, so that freeing it
+            can stop the voice
+    @param  The priority of the new sound
+    @return The voice, or -1 if there was none to take
+==============================*/
+
+int sfxbank_take_voice(const void* owner, int priority)
+{
+    int voice = -1;
+    for (int i=0; i<sfxbank_get_voicecount(); i++)
+    {
+        const SfxVoice* v = &global_sfxbank_voices[i];
+        if (v->owner == NULL || !mixer_ch_playing(SFXBANK_FIRST_CHANNEL + i))
+        {
+            voice = i;
+            break;
+        }
+        if (v->priority > priority)
+            continue;
+        if (voice == -1 || v->priority < global_sfxbank_voices[voice].priority ||
+            (v->priority == global_sfxbank_voices[voice].priority && v->started < global_sfxbank_voices[voice].started))
+            voice = i;
+    }
+    if (voice == -1)
+        return -1;
+
+    global_sfxbank_voices[voice] = (SfxVoice){
+        .owner = owner,
+        .priority = priority,
+        .started = global_sfxbank_playcount++,
+    };
+    mixer_ch_stop(SFXBANK_FIRST_CHANNEL + voice);
+    return voice;
+}
+
+
+/*==============================
+    sfxbank_play
+    Plays a sample on a voice from sfxbank_take_voice
+    @param  The sample to play
+    @param  The priority of this sound
+    @param  The volume, from 0 to 1
+    @return The voice playing the sample, or -1 if the
+            sound was dropped
+==============================*/
+
+int sfxbank_play(const SfxSample* sample, int priority, float volume)
+{
+    int voice = sfxbank_take_voice(sample, priority);
+    if (voice == -1)
+        return -1;
+    mixer_ch_set_vol(SFXBANK_FIRST_CHANNEL + voice, volume, volume);
+    mixer_ch_play(SFXBANK_FIRST_CHANNEL + voice, (waveform_t*)&sample->wave);
+    return voice;
+}
+
+
+/*==============================
+    sfxbank_stop
+    Stops a voice
+    @param  The voice returned by sfxbank_play
+==============================*/
+
+void sfxbank_stop(int voice)
+{
+    assertf(voice >= 0 && voice < SFXBANK_VOICES, "Invalid SFX voice %d", voice);
+    mixer_ch_stop(SFXBANK_FIRST_CHANNEL + voice);
+    global_sfxbank_voices[voice].owner = NULL;
+}
+
+
+/*==============================
+    sfxbank_get_channel
+    Gets the mixer channel of a voice, for changing its
+    volume or frequency while it plays
+    @param  The voice returned by sfxbank_play
+    @return The mixer channel
+==============================*/
+
+int sfxbank_get_channel(int voice)
+{
+    assertf(voice >= 0 && voice < SFXBANK_VOICES, "Invalid SFX voice %d", voice);
+    return SFXBANK_FIRST_CHANNEL + voice;
+}
+
+
+/*==============================
+    sfxbank_stopall
+    Stops every voice. Called by the core when a minigame
+    ends, before its samples are freed.
+==============================*/
+
+void sfxbank_stopall()
+{
+    for (int i=0; i<sfxbank_get_voicecount(); i++)
+        sfxbank_stop(i);
+}
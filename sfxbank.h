@@ -0,0 +1,99 @@
+#ifndef GAMEJAM2024_SFXBANK_H
+#define GAMEJAM2024_SFXBANK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+    /***************************************************************
+                      Public SFX Bank Constants
+    ***************************************************************/
+
+    // The mixer channels played through by the bank, which minigames shouldn't use themselves.
+    // A minigame with fewer mixer channels than these gets fewer voices.
+    #define SFXBANK_FIRST_CHANNEL  16
+    #define SFXBANK_VOICES         8
+
+    // A short sound kept decoded in RAM, that any number of voices can play at once
+    typedef struct {
+        waveform_t wave;
+        uint8_t* data;
+        int shift;
+    } SfxSample;
+
+
+    /***************************************************************
+                      Public SFX Bank Functions
+    ***************************************************************/
+
+    /*==============================
+        sfxbank_load
+        Reads a whole wav64 into RAM, decoding it once if it is
+        compressed, so that playing it never goes back to the
+        ROM or the decoder
+        @param  The sample to load into
+        @param  The path to the wav64 file
+    ==============================*/
+    void sfxbank_load(SfxSample* sample, const char* path);
+
+    /*==============================
+        sfxbank_free
+        Stops every voice playing a sample and frees it
+        @param  The sample to free
+    ==============================*/
+    void sfxbank_free(SfxSample* sample);
+
+    /*==============================
+        sfxbank_take_voice
+        Takes a free voice. If every voice is busy, the one with
+        the lowest priority is stolen, picking the oldest among
+        equals, but only if its priority isn't higher than the
+        new sound's.
+        @param  What will play on the voice, so that freeing it
+                can stop the voice
+        @param  The priority of the new sound
+        @return The voice, or -1 if there was none to take
+    ==============================*/
+    int sfxbank_take_voice(const void* owner, int priority);
+
+    /*==============================
+        sfxbank_play
+        Plays a sample on a voice from sfxbank_take_voice
+        @param  The sample to play
+        @param  The priority of this sound
+        @param  The volume, from 0 to 1
+        @return The voice playing the sample, or -1 if the
+                sound was dropped
+    ==============================*/
+    int sfxbank_play(const SfxSample* sample, int priority, float volume);
+
+    /*==============================
+        sfxbank_stop
+        Stops a voice
+        @param  The voice returned by sfxbank_play
+    ==============================*/
+    void sfxbank_stop(int voice);
+
+    /*==============================
+        sfxbank_get_channel
+        Gets the mixer channel of a voice, for changing its
+        volume or frequency while it plays
+        @param  The voice returned by sfxbank_play
+        @return The mixer channel
+    ==============================*/
+    int sfxbank_get_channel(int voice);
+
+
+    /***************************************************************
+                         Internal SFX Bank
+                  Do not use anything below this line
+    ***************************************************************/
+
+    void sfxbank_stopall();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
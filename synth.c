@@ -0,0 +1,280 @@
+/***************************************************************
+                            synth.c
+
+Generates noisy sound effects on the fly, by filtering white
+noise through resonators under an envelope, and plays them on
+the SFX bank's voices.
+***************************************************************/
+
+#include <libdragon.h>
+#include <math.h>
+#include "sfxbank.h"
+#include "synth.h"
+
+
+/*********************************
+             Macros
+*********************************/
+
+// The envelope and the resonator frequencies are recalculated once per block
+#define SYNTH_BLOCK  32
+
+// Every sound fades out over its last few blocks so it doesn't end in a click
+#define SYNTH_FADE   (SYNTH_BLOCK*8)
+
+#define SYNTH_PI     3.14159265f
+
+
+/*********************************
+             Structs
+*********************************/
+
+typedef struct {
+    float frequency;
+    float sweep;
+    float radius;
+    int32_t a1;
+    int32_t a2;
+    int32_t b0;
+    int32_t gain;
+    int32_t y1;
+    int32_t y2;
+} SynthResonatorState;
+
+typedef struct {
+    waveform_t wave;
+    const SynthPatch* patch;
+    int position;
+    int attack;
+    float decay;
+    uint32_t seed;
+    int32_t envelope;
+    int32_t envelopestep;
+    int32_t noisegain;
+    int32_t lowpass;
+    int32_t highpass;
+    int32_t lowpassstate;
+    int32_t highpassstate;
+    int resonatorcount;
+    SynthResonatorState resonators[SYNTH_MAXRESONATORS];
+} SynthInstance;
+
+
+/*********************************
+       Function Prototypes
+*********************************/
+
+static void synth_read(void* ctx, samplebuffer_t* sbuf, int wpos, int wlen, bool seeking);
+
+
+/*********************************
+             Globals
+*********************************/
+
+// One sound per voice of the SFX bank
+static SynthInstance global_synth_instances[SFXBANK_VOICES];
+
+
+/*==============================
+    synth_vary
+    Changes a value by a random amount
+    @param  The instance, whose seed is used
+    @param  The value to change
+    @param  The most it can change by, from 0 to 1
+    @return The changed value
+==============================*/
+
+static float synth_vary(SynthInstance* inst, float value, float variation)
+{
+    inst->seed = inst->seed*1664525 + 1013904223;
+    return value*(1.0f + variation*((float)(int32_t)inst->seed/2147483648.0f));
+}
+
+
+/*==============================
+    synth_onepole
+    Gets the coefficient of a one pole filter
+    @param  The cutoff frequency
+    @return The coefficient, in 2.14 fixed point
+==============================*/
+
+static int32_t synth_onepole(float cutoff)
+{
+    return (int32_t)((1.0f - expf(-2.0f*SYNTH_PI*cutoff/SYNTH_FREQUENCY))*16384.0f);
+}
+
+
+/*==============================
+    synth_update_block
+    Works out the envelope and the resonator coefficients
+    for the block of samples starting at the current position
+    @param  The instance to update
+==============================*/
+
+static void synth_update_block(SynthInstance* inst)
+{
+    int next = inst->position + SYNTH_BLOCK;
+    float target;
+    float progress = (float)inst->position/(float)inst->wave.len;
+
+    // Ramp up during the attack, then fall off exponentially
+    if (next < inst->attack)
+        target = (float)next/(float)inst->attack;
+    else
+        target = expf(-(float)(next - inst->attack)/inst->decay);
+    if (inst->wave.len - next < SYNTH_FADE)
+        target *= inst->wave.len > next ? (float)(inst->wave.len - next)/SYNTH_FADE : 0.0f;
+    inst->envelopestep = ((int32_t)(target*32767.0f) - inst->envelope)/SYNTH_BLOCK;
+
+    for (int i=0; i<inst->resonatorcount; i++)
+    {
+        SynthResonatorState* res = &inst->resonators[i];
+        float frequency = res->frequency;
+        float theta;
+        if (res->sweep != 1.0f)
+            frequency *= powf(res->sweep, progress);
+        theta = 2.0f*SYNTH_PI*frequency/SYNTH_FREQUENCY;
+
+        // Scaled so the band peaks at roughly unity gain
+        res->a1 = (int32_t)(2.0f*res->radius*cosf(theta)*16384.0f);
+        res->a2 = (int32_t)(res->radius*res->radius*16384.0f);
+        res->b0 = (int32_t)((1.0f - res->radius)*2.0f*sinf(theta)*16384.0f);
+    }
+}
+
+
+/*==============================
+    synth_start
+    Sets up an instance to play a patch from the beginning
+    @param  The instance to set up
+    @param  The patch to play
+==============================*/
+
+static void synth_start(SynthInstance* inst, const SynthPatch* patch)
+{
+    float variation = patch->variation;
+    inst->patch = patch;
+    inst->position = 0;
+    inst->seed = rand();
+    inst->attack = patch->attack*SYNTH_FREQUENCY;
+    if (inst->attack < 1)
+        inst->attack = 1;
+    inst->decay = synth_vary(inst, patch->decay, variation)*SYNTH_FREQUENCY;
+    inst->envelope = 0;
+    inst->noisegain = patch->noise*4096.0f;
+    inst->lowpass = patch->lowpass > 0 ? synth_onepole(synth_vary(inst, patch->lowpass, variation)) : 16384;
+    inst->highpass = patch->highpass > 0 ? synth_onepole(synth_vary(inst, patch->highpass, variation)) : 0;
+    inst->lowpassstate = 0;
+    inst->highpassstate = 0;
+
+    inst->resonatorcount = 0;
+    for (int i=0; i<SYNTH_MAXRESONATORS; i++)
+    {
+        const SynthResonator* src = &patch->resonators[i];
+        SynthResonatorState* res = &inst->resonators[inst->resonatorcount];
+        if (src->frequency <= 0)
+            continue;
+        res->frequency = synth_vary(inst, src->frequency, variation);
+        res->sweep = src->sweep > 0 ? src->sweep : 1.0f;
+        res->radius = expf(-SYNTH_PI*src->bandwidth/SYNTH_FREQUENCY);
+        res->gain = src->gain*4096.0f;
+        res->y1 = 0;
+        res->y2 = 0;
+        inst->resonatorcount++;
+    }
+
+    inst->wave = (waveform_t){
+        .name = "synth",
+        .bits = 16,
+        .channels = 1,
+        .frequency = SYNTH_FREQUENCY,
+        .len = synth_vary(inst, patch->length, variation)*SYNTH_FREQUENCY,
+        .loop_len = 0,
+        .read = synth_read,
+        .ctx = inst,
+    };
+}
+
+
+/*==============================
+    synth_read
+    The mixer's read callback, which generates the requested
+    samples
+==============================*/
+
+static void synth_read(void* ctx, samplebuffer_t* sbuf, int wpos, int wlen, bool seeking)
+{
+    SynthInstance* inst = (SynthInstance*)ctx;
+    int16_t* dest = (int16_t*)samplebuffer_append(sbuf, wlen);
+
+    // The noise can't be rewound, so seeking anywhere but the start just carries on
+    if (seeking && wpos == 0 && inst->position != 0)
+        synth_start(inst, inst->patch);
+
+    for (int i=0; i<wlen; i++)
+    {
+        uint32_t seed;
+        int32_t white;
+        int32_t noise;
+        int64_t mix;
+
+        if (inst->position % SYNTH_BLOCK == 0)
+            synth_update_block(inst);
+
+        // White noise, then a one pole lowpass and highpass to colour it
+        seed = inst->seed = inst->seed*1664525 + 1013904223;
+        white = (int32_t)seed >> 16;
+        inst->lowpassstate += ((white - inst->lowpassstate)*inst->lowpass) >> 14;
+        inst->highpassstate += ((inst->lowpassstate - inst->highpassstate)*inst->highpass) >> 14;
+        noise = inst->lowpassstate - inst->highpassstate;
+        mix = (int64_t)noise*inst->noisegain;
+
+        // The resonators ring on the white noise
+        for (int j=0; j<inst->resonatorcount; j++)
+        {
+            SynthResonatorState* res = &inst->resonators[j];
+            int32_t y = ((int64_t)white*res->b0 + (int64_t)res->y1*res->a1 - (int64_t)res->y2*res->a2) >> 14;
+            res->y2 = res->y1;
+            res->y1 = y;
+            mix += (int64_t)y*res->gain;
+        }
+
+        mix = ((mix >> 12)*inst->envelope) >> 15;
+        if (mix > 32767)
+            mix = 32767;
+        else if (mix < -32768)
+            mix = -32768;
+        dest[i] = mix;
+
+        inst->envelope += inst->envelopestep;
+        inst->position++;
+    }
+}
+
+
+/*==============================
+    synth_play
+    Generates a patch on the fly on one of the SFX bank's
+    voices, with its own random variation. Nothing is read
+    from the ROM, and the patch must stay valid while it
+    plays.
+    @param  The patch to play
+    @param  The priority of this sound (see sfxbank_play)
+    @param  The volume, from 0 to 1
+    @return The voice playing the sound, or -1 if the
+            sound was dropped
+==============================*/
+
+int synth_play(const SynthPatch* patch, int priority, float volume)
+{
+    int voice = sfxbank_take_voice(patch, priority);
+    SynthInstance* inst;
+    if (voice == -1)
+        return -1;
+
+    inst = &global_synth_instances[voice];
+    synth_start(inst, patch);
+    mixer_ch_set_vol(sfxbank_get_channel(voice), volume, volume);
+    mixer_ch_play(sfxbank_get_channel(voice), &inst->wave);
+    return voice;
+}
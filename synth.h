@@ -0,0 +1,62 @@
+#ifndef GAMEJAM2024_SYNTH_H
+#define GAMEJAM2024_SYNTH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+    /***************************************************************
+                        Public Synth Constants
+    ***************************************************************/
+
+    // The sample rate every synthesized sound is generated at
+    #define SYNTH_FREQUENCY      22050
+
+    // How many resonators a patch can have
+    #define SYNTH_MAXRESONATORS  3
+
+    // A band of the noise that rings at a frequency
+    typedef struct {
+        float frequency;    // The centre frequency, in Hz, or 0 to disable the resonator
+        float bandwidth;    // The width of the band in Hz. Narrower bands ring longer.
+        float gain;         // How loud the band is in the mix
+        float sweep;        // How much the frequency is multiplied by at the end of the sound
+    } SynthResonator;
+
+    // The description of a sound made out of filtered noise under an envelope
+    typedef struct {
+        float length;       // How long the sound plays for, in seconds
+        float attack;       // How long it takes to reach full volume, in seconds
+        float decay;        // How long it takes to fall to a third of its volume after the attack, in seconds
+        float noise;        // How loud the filtered noise is in the mix on its own
+        float lowpass;      // The noise is cut above this frequency in Hz, or 0 to leave it
+        float highpass;     // The noise is cut below this frequency in Hz, or 0 to leave it
+        float variation;    // How much lengths and frequencies change randomly each time, from 0 to 1
+        SynthResonator resonators[SYNTH_MAXRESONATORS];
+    } SynthPatch;
+
+
+    /***************************************************************
+                        Public Synth Functions
+    ***************************************************************/
+
+    /*==============================
+        synth_play
+        Generates a patch on the fly on one of the SFX bank's
+        voices, with its own random variation. Nothing is read
+        from the ROM, and the patch must stay valid while it
+        plays.
+        @param  The patch to play
+        @param  The priority of this sound (see sfxbank_play)
+        @param  The volume, from 0 to 1
+        @return The voice playing the sound, or -1 if the
+                sound was dropped
+    ==============================*/
+    int synth_play(const SynthPatch* patch, int priority, float volume);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,375 @@
+/***************************************************************
+                          textcache.c
+                               
+Keeps the layouts of recently printed strings so that text which
+is printed every frame is only parsed and laid out once.
+***************************************************************/
+
+#include <libdragon.h>
+#include <stdarg.h>
+#include <string.h>
+#include "textcache.h"
+#include "renderstats.h"
+
+
+/*********************************
+            Structures
+*********************************/
+
+typedef struct {
+    rdpq_paragraph_t* layout;
+    char* text;
+    rdpq_textparms_t parms;
+    uint32_t hash;
+    uint32_t lastused;
+    uint8_t fontid;
+    bool queued;
+} TextCacheEntry;
+
+typedef struct {
+    TextCacheEntry* entry;
+    float x;
+    float y;
+} TextQueueItem;
+
+
+/*********************************
+             Globals
+*********************************/
+
+static TextCacheEntry global_textcache_entries[TEXTCACHE_SIZE];
+static uint32_t global_textcache_clock = 0;
+static TextQueueItem global_textqueue[TEXTQUEUE_SIZE];
+static int global_textqueue_count = 0;
+
+
+/*==============================
+    textcache_hash
+    Hashes a cache key with FNV-1a
+    @param  The text parameters
+    @param  The font id
+    @param  The string
+    @return The hash
+==============================*/
+
+static uint32_t textcache_hash(const rdpq_textparms_t* parms, uint8_t font_id, const char* text)
+{
+    uint32_t hash = 2166136261u ^ font_id;
+    const uint8_t* bytes = (const uint8_t*)parms;
+    for (int i=0; i<sizeof(rdpq_textparms_t); i++)
+        hash = (hash ^ bytes[i])*16777619u;
+    for (; *text != '\0'; text++)
+        hash = (hash ^ (uint8_t)*text)*16777619u;
+    return hash;
+}
+
+
+/*==============================
+    textcache_makekey
+    Copies the text parameters field by field into a zeroed
+    struct, so the padding between them never reaches the
+    hash or the comparison
+    @param  The text parameters, or NULL
+    @param  Where to store the key
+==============================*/
+
+static void textcache_makekey(const rdpq_textparms_t* parms, rdpq_textparms_t* key)
+{
+    // Passing no parameters is the same as passing the defaults
+    memset(key, 0, sizeof(rdpq_textparms_t));
+    if (parms == NULL)
+        return;
+    key->style_id = parms->style_id;
+    key->width = parms->width;
+    key->height = parms->height;
+    key->align = parms->align;
+    key->valign = parms->valign;
+    key->indent = parms->indent;
+    key->max_chars = parms->max_chars;
+    key->char_spacing = parms->char_spacing;
+    key->line_spacing = parms->line_spacing;
+    key->wrap = parms->wrap;
+    key->tabstops = parms->tabstops;
+    key->disable_aa_fix = parms->disable_aa_fix;
+    key->preserve_overlap = parms->preserve_overlap;
+}
+
+
+/*==============================
+    textcache_lookup
+    Finds the layout of a string, laying it out and
+    evicting the least recently used one if needed
+    @param  The text parameters, or NULL
+    @param  The initial font id
+    @param  The string
+    @return The cache entry
+==============================*/
+
+static TextCacheEntry* textcache_lookup(const rdpq_textparms_t* parms, uint8_t font_id, const char* text)
+{
+    rdpq_textparms_t key;
+    TextCacheEntry* victim = NULL;
+
+    textcache_makekey(parms, &key);
+    uint32_t hash = textcache_hash(&key, font_id, text);
+
+    global_textcache_clock++;
+    for (int i=0; i<TEXTCACHE_SIZE; i++)
+    {
+        TextCacheEntry* entry = &global_textcache_entries[i];
+        if (entry->layout == NULL)
+        {
+            victim = entry;
+            continue;
+        }
+        if (entry->hash == hash && entry->fontid == font_id && !strcmp(entry->text, text) && !memcmp(&entry->parms, &key, sizeof(key)))
+        {
+            entry->lastused = global_textcache_clock;
+            return entry;
+        }
+        // Queued layouts must stay alive until they are drawn
+        if (!entry->queued && (victim == NULL || (victim->layout != NULL && entry->lastused < victim->lastused)))
+            victim = entry;
+    }
+
+    // Not cached, so replace the least recently used entry
+    assertf(victim != NULL, "Every cached string is queued, flush the text queue more often");
+    if (victim->layout != NULL)
+    {
+        rdpq_paragraph_free(victim->layout);
+        free(victim->text);
+    }
+    int nbytes = strlen(text);
+    victim->layout = rdpq_paragraph_build(&key, font_id, text, &nbytes);
+    victim->text = strdup(text);
+    victim->parms = key;
+    victim->hash = hash;
+    victim->fontid = font_id;
+    victim->lastused = global_textcache_clock;
+    victim->queued = false;
+    return victim;
+}
+
+
+/*==============================
+    textcache_print
+    Works like rdpq_text_print, but keeps the layout of the
+    string around so that printing it again with the same
+    font and parameters skips parsing and layout.
+    @param  The text parameters, or NULL
+    @param  The initial font id
+    @param  The x position
+    @param  The y position
+    @param  The string to print
+    @return The text metrics
+==============================*/
+
+rdpq_textmetrics_t textcache_print(const rdpq_textparms_t* parms, uint8_t font_id, float x, float y, const char* text)
+{
+    TextCacheEntry* entry = textcache_lookup(parms, font_id, text);
+    rdpq_paragraph_render(entry->layout, x, y);
+    return (rdpq_textmetrics_t){
+        .advance_x = entry->layout->advance_x,
+        .advance_y = entry->layout->advance_y,
+        .utf8_text_advance = strlen(text),
+    };
+}
+
+
+/*==============================
+    textcache_printf
+    Works like rdpq_text_printf, caching the layout of the
+    formatted string like textcache_print
+    @param  The text parameters, or NULL
+    @param  The initial font id
+    @param  The x position
+    @param  The y position
+    @param  The format string
+    @param  The format arguments
+    @return The text metrics
+==============================*/
+
+rdpq_textmetrics_t textcache_printf(const rdpq_textparms_t* parms, uint8_t font_id, float x, float y, const char* fmt, ...)
+{
+    char buf[TEXTCACHE_MAXLEN];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    assertf(len < sizeof(buf), "String is too long to cache (%d bytes)", len);
+    return textcache_print(parms, font_id, x, y, buf);
+}
+
+
+/*==============================
+    textcache_get_digit
+    Gets the layout of a single character of a number
+    @param  The font id
+    @param  The style id
+    @param  The character
+    @return The cache entry
+==============================*/
+
+static TextCacheEntry* textcache_get_digit(uint8_t font_id, uint8_t style_id, char c)
+{
+    char str[2] = {c, '\0'};
+    return textcache_lookup(&(rdpq_textparms_t){.style_id = style_id}, font_id, str);
+}
+
+
+/*==============================
+    textcache_print_int
+    Prints a number by putting together the cached layouts
+    of each of its digits, so that changing numbers like
+    timers don't need a layout per value
+    @param  The font id
+    @param  The style id
+    @param  The x position of the left of the number
+    @param  The y position of the baseline
+    @param  The number to print
+    @return The width of the printed number
+==============================*/
+
+float textcache_print_int(uint8_t font_id, uint8_t style_id, float x, float y, int value)
+{
+    char buf[12];
+    float x0 = x;
+    snprintf(buf, sizeof(buf), "%d", value);
+    for (char* c = buf; *c != '\0'; c++)
+    {
+        TextCacheEntry* entry = textcache_get_digit(font_id, style_id, *c);
+        rdpq_paragraph_render(entry->layout, x, y);
+        x += entry->layout->advance_x;
+    }
+    return x - x0;
+}
+
+
+/*==============================
+    textcache_get_int_width
+    Gets how wide textcache_print_int would print a number
+    @param  The font id
+    @param  The style id
+    @param  The number to measure
+    @return The width of the number
+==============================*/
+
+float textcache_get_int_width(uint8_t font_id, uint8_t style_id, int value)
+{
+    char buf[12];
+    float width = 0;
+    snprintf(buf, sizeof(buf), "%d", value);
+    for (char* c = buf; *c != '\0'; c++)
+        width += textcache_get_digit(font_id, style_id, *c)->layout->advance_x;
+    return width;
+}
+
+
+/*==============================
+    textcache_queue
+    Like textcache_print, but the string is only drawn
+    when textcache_queue_flush is called
+    @param  The text parameters, or NULL
+    @param  The initial font id
+    @param  The x position
+    @param  The y position
+    @param  The string to print
+==============================*/
+
+void textcache_queue(const rdpq_textparms_t* parms, uint8_t font_id, float x, float y, const char* text)
+{
+    assertf(global_textqueue_count < TEXTQUEUE_SIZE, "Text queue is full");
+    TextQueueItem* item = &global_textqueue[global_textqueue_count++];
+    item->entry = textcache_lookup(parms, font_id, text);
+    item->entry->queued = true;
+    item->x = x;
+    item->y = y;
+}
+
+
+/*==============================
+    textcache_queuef
+    Like textcache_printf, but the string is only drawn
+    when textcache_queue_flush is called
+    @param  The text parameters, or NULL
+    @param  The initial font id
+    @param  The x position
+    @param  The y position
+    @param  The format string
+    @param  The format arguments
+==============================*/
+
+void textcache_queuef(const rdpq_textparms_t* parms, uint8_t font_id, float x, float y, const char* fmt, ...)
+{
+    char buf[TEXTCACHE_MAXLEN];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    assertf(len < sizeof(buf), "String is too long to cache (%d bytes)", len);
+    textcache_queue(parms, font_id, x, y, buf);
+}
+
+
+/*==============================
+    textcache_queue_flush
+    Draws every queued string, grouped by font and style,
+    behind a single pipe and tile sync. Call it once per
+    frame after everything the text should cover is drawn.
+==============================*/
+
+void textcache_queue_flush()
+{
+    if (global_textqueue_count == 0)
+        return;
+
+    // Stable sort by font and style so that strings sharing them are drawn together
+    for (int i=1; i<global_textqueue_count; i++)
+    {
+        TextQueueItem item = global_textqueue[i];
+        int key = (item.entry->fontid << 8) | item.entry->parms.style_id;
+        int j = i;
+        for (; j>0; j--)
+        {
+            const TextCacheEntry* prev = global_textqueue[j-1].entry;
+            if (((prev->fontid << 8) | prev->parms.style_id) <= key)
+                break;
+            global_textqueue[j] = global_textqueue[j-1];
+        }
+        global_textqueue[j] = item;
+    }
+
+    // Whatever was drawn before might still be using the pipe and tiles
+    rstat_sync_pipe("textcache");
+    rstat_sync_tile("textcache");
+    for (int i=0; i<global_textqueue_count; i++)
+    {
+        TextQueueItem* item = &global_textqueue[i];
+        rdpq_paragraph_render(item->entry->layout, item->x, item->y);
+        item->entry->queued = false;
+    }
+    global_textqueue_count = 0;
+}
+
+
+/*==============================
+    textcache_flush
+    Drops every cached layout. Called by the core whenever
+    the registered fonts might change.
+==============================*/
+
+void textcache_flush()
+{
+    for (int i=0; i<TEXTCACHE_SIZE; i++)
+    {
+        TextCacheEntry* entry = &global_textcache_entries[i];
+        if (entry->layout == NULL)
+            continue;
+        rdpq_paragraph_free(entry->layout);
+        free(entry->text);
+        entry->layout = NULL;
+        entry->text = NULL;
+        entry->queued = false;
+    }
+    global_textqueue_count = 0;
+}
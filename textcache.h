@@ -0,0 +1,125 @@
+#ifndef GAMEJAM2024_TEXTCACHE_H
+#define GAMEJAM2024_TEXTCACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+    /***************************************************************
+                      Public Text Cache Constants
+    ***************************************************************/
+
+    // How many laid out strings are kept before the least recently used is dropped
+    #define TEXTCACHE_SIZE    48
+
+    // The longest string textcache_printf can format
+    #define TEXTCACHE_MAXLEN  512
+
+    // How many strings can be queued before a flush
+    #define TEXTQUEUE_SIZE    32
+
+
+    /***************************************************************
+                      Public Text Cache Functions
+    ***************************************************************/
+
+    /*==============================
+        textcache_print
+        Works like rdpq_text_print, but keeps the layout of the
+        string around so that printing it again with the same
+        font and parameters skips parsing and layout.
+        @param  The text parameters, or NULL
+        @param  The initial font id
+        @param  The x position
+        @param  The y position
+        @param  The string to print
+        @return The text metrics
+    ==============================*/
+    rdpq_textmetrics_t textcache_print(const rdpq_textparms_t* parms, uint8_t font_id, float x, float y, const char* text);
+
+    /*==============================
+        textcache_printf
+        Works like rdpq_text_printf, caching the layout of the
+        formatted string like textcache_print
+        @param  The text parameters, or NULL
+        @param  The initial font id
+        @param  The x position
+        @param  The y position
+        @param  The format string
+        @param  The format arguments
+        @return The text metrics
+    ==============================*/
+    rdpq_textmetrics_t textcache_printf(const rdpq_textparms_t* parms, uint8_t font_id, float x, float y, const char* fmt, ...) __attribute__((format(printf, 5, 6)));
+
+    /*==============================
+        textcache_print_int
+        Prints a number by putting together the cached layouts
+        of each of its digits, so that changing numbers like
+        timers don't need a layout per value
+        @param  The font id
+        @param  The style id
+        @param  The x position of the left of the number
+        @param  The y position of the baseline
+        @param  The number to print
+        @return The width of the printed number
+    ==============================*/
+    float textcache_print_int(uint8_t font_id, uint8_t style_id, float x, float y, int value);
+
+    /*==============================
+        textcache_get_int_width
+        Gets how wide textcache_print_int would print a number
+        @param  The font id
+        @param  The style id
+        @param  The number to measure
+        @return The width of the number
+    ==============================*/
+    float textcache_get_int_width(uint8_t font_id, uint8_t style_id, int value);
+
+
+    /*==============================
+        textcache_queue
+        Like textcache_print, but the string is only drawn
+        when textcache_queue_flush is called
+        @param  The text parameters, or NULL
+        @param  The initial font id
+        @param  The x position
+        @param  The y position
+        @param  The string to print
+    ==============================*/
+    void textcache_queue(const rdpq_textparms_t* parms, uint8_t font_id, float x, float y, const char* text);
+
+    /*==============================
+        textcache_queuef
+        Like textcache_printf, but the string is only drawn
+        when textcache_queue_flush is called
+        @param  The text parameters, or NULL
+        @param  The initial font id
+        @param  The x position
+        @param  The y position
+        @param  The format string
+        @param  The format arguments
+    ==============================*/
+    void textcache_queuef(const rdpq_textparms_t* parms, uint8_t font_id, float x, float y, const char* fmt, ...) __attribute__((format(printf, 5, 6)));
+
+    /*==============================
+        textcache_queue_flush
+        Draws every queued string, grouped by font and style,
+        behind a single pipe and tile sync. Call it once per
+        frame after everything the text should cover is drawn.
+    ==============================*/
+    void textcache_queue_flush();
+
+
+    /***************************************************************
+                      Internal Text Cache Functions
+                  Do not use anything below this line
+    ***************************************************************/
+
+    void textcache_flush();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif